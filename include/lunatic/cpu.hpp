@@ -67,13 +67,52 @@ struct CPU {
       ARM7,
       ARM9
     } model = Model::ARM9;
+    enum class Engine {
+      JIT,
+      Interpreter
+    } engine = Engine::JIT;
     int block_size = 32;
+    int superblock_size = 64;
+    int hotness_threshold = 1000;
+
+    // Number of times the JIT interprets a basic block before compiling it (zero compiles it right away).
+    int interpreter_threshold = 0;
+
+    size_t code_buffer_size = 32 * 1024 * 1024;
+
+    /* Translate basic blocks on a separate thread and interpret the guest code until they are ready.
+     * That thread only reads code directly from the ITCM and the page table, it never calls the Memory methods.
+     * Code which is fetched through the Memory methods is translated on the emulation thread instead.
+     * Coprocessor::ShouldWriteBreakBasicBlock() is called on the translation thread.
+     */
+    bool background_compilation = false;
+  };
+
+  /* Refers to the IRQ line, so that code which assigns to IRQLine() keeps working.
+   * IRQLine() used to return bool&, now assignments go through SetIRQLine().
+   * Code that binds IRQLine() to a bool& must call SetIRQLine() instead,
+   * since the CPU has to know when the line is raised to stop running guest code.
+   */
+  struct IRQLineReference {
+    operator bool() const {
+      return static_cast<CPU const&>(cpu).IRQLine();
+    }
+
+    auto operator=(bool level) -> IRQLineReference& {
+      cpu.SetIRQLine(level);
+      return *this;
+    }
+
+    CPU& cpu;
   };
 
   virtual ~CPU() = default;
 
   virtual void Reset() = 0;
-  virtual auto IRQLine() -> bool& = 0;
+  virtual auto IRQLine() const -> bool = 0;
+  auto IRQLine() -> IRQLineReference { return {*this}; }
+  virtual void SetIRQLine(bool level) = 0;
+  virtual void RequestExit() = 0;
   virtual auto WaitForIRQ() -> bool& = 0;
   virtual void ClearICache() = 0;
   virtual void ClearICacheRange(u32 address_lo, u32 address_hi) = 0;
@@ -11,6 +11,7 @@
 #include <lunatic/integer.hpp>
 #include <lunatic/detail/meta.hpp>
 #include <lunatic/detail/punning.hpp>
+#include <functional>
 #include <memory>
 
 namespace lunatic {
@@ -73,6 +74,10 @@ struct Memory {
 
     address &= ~(sizeof(T) - 1);
 
+    if (code_pages != nullptr && ((code_pages[address >> kPageShift] >> ((address & kPageMask) >> kCodeLineShift)) & 1) != 0) {
+      code_write_handler(address, sizeof(T));
+    }
+
     if constexpr (bus != Bus::System) {
       if (itcm.config.enable &&
           address >= itcm.config.base &&
@@ -104,9 +109,27 @@ struct Memory {
 
   static constexpr int kPageShift = 12; // 2^12 = 4096
   static constexpr int kPageMask = (1 << kPageShift) - 1;
+  static constexpr int kCodeLineShift = 7; // 2^7 = 128, 32 lines per page
 
   std::unique_ptr<std::array<u8*, 1048576>> pagetable = nullptr;
 
+  /**
+   * Set up by the JIT: one 32-bit mask per page, where each bit marks a 128-byte line that contains compiled code.
+   * Writes to these lines are reported to code_write_handler, so that the code can be invalidated.
+   * Lines are also marked in mirrors of the code: pages which the page table maps to the same host memory
+   * and mirrors within the TCMs. Call CPU::ClearICache() after changing the page table, so that new mirrors are found.
+   * Writes which bypass FastWrite and the compiled code (i.e. DMA by the host) still require CPU::ClearICacheRange().
+   */
+  u32 const* code_pages = nullptr;
+  std::function<void(u32 address, u32 size)> code_write_handler;
+
+  /**
+   * Optional: one bit per page, set for pages that are mapped in the page table and are never written (i.e. ROM).
+   * Reads from constant addresses in these pages may be replaced by the value read at compile time,
+   * so call CPU::ClearICache() after changing the contents or the mapping of such a page.
+   */
+  std::unique_ptr<std::array<u32, 1048576 / 32>> read_only_pages = nullptr;
+
   struct TCM {
     u8* data = nullptr;
     u32 mask = 0;
@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <list>
 #include <stdexcept>
 
@@ -25,27 +26,100 @@
 namespace lunatic {
 namespace backend {
 
+/// Check if an opcode overwrites the host flags register (AX).
+static bool WritesHostFlags(IROpcode* op) {
+  switch (op->GetClass()) {
+    case IROpcodeClass::ClearCarry:
+    case IROpcodeClass::SetCarry:
+    case IROpcodeClass::QADD:
+    case IROpcodeClass::QSUB: return true;
+    case IROpcodeClass::LSL: return lunatic_cast<IRLogicalShiftLeft>(op)->update_host_flags;
+    case IROpcodeClass::LSR: return lunatic_cast<IRLogicalShiftRight>(op)->update_host_flags;
+    case IROpcodeClass::ASR: return lunatic_cast<IRArithmeticShiftRight>(op)->update_host_flags;
+    case IROpcodeClass::ROR: return lunatic_cast<IRRotateRight>(op)->update_host_flags;
+    case IROpcodeClass::AND: return lunatic_cast<IRBitwiseAND>(op)->update_host_flags;
+    case IROpcodeClass::BIC: return lunatic_cast<IRBitwiseBIC>(op)->update_host_flags;
+    case IROpcodeClass::EOR: return lunatic_cast<IRBitwiseEOR>(op)->update_host_flags;
+    case IROpcodeClass::SUB: return lunatic_cast<IRSub>(op)->update_host_flags;
+    case IROpcodeClass::RSB: return lunatic_cast<IRRsb>(op)->update_host_flags;
+    case IROpcodeClass::ADD: return lunatic_cast<IRAdd>(op)->update_host_flags;
+    case IROpcodeClass::ADC: return lunatic_cast<IRAdc>(op)->update_host_flags;
+    case IROpcodeClass::SBC: return lunatic_cast<IRSbc>(op)->update_host_flags;
+    case IROpcodeClass::RSC: return lunatic_cast<IRRsc>(op)->update_host_flags;
+    case IROpcodeClass::ORR: return lunatic_cast<IRBitwiseORR>(op)->update_host_flags;
+    case IROpcodeClass::MOV: return lunatic_cast<IRMov>(op)->update_host_flags;
+    case IROpcodeClass::MVN: return lunatic_cast<IRMvn>(op)->update_host_flags;
+    case IROpcodeClass::MUL: return lunatic_cast<IRMultiply>(op)->update_host_flags;
+    case IROpcodeClass::ADD64: return lunatic_cast<IRAdd64>(op)->update_host_flags;
+    default: return false;
+  }
+}
+
+/// Check if an opcode may call into C++ code, which may read the CPSR from the state.
+static bool CallsIntoHost(IROpcode* op) {
+  switch (op->GetClass()) {
+    case IROpcodeClass::MemoryRead:
+    case IROpcodeClass::MemoryWrite:
+    case IROpcodeClass::MRC:
+    case IROpcodeClass::MCR: return true;
+    default: return false;
+  }
+}
+
+/// Remove a basic block from the list of basic blocks that is associated with a block key.
+static void RemoveFromBlockTable(
+  std::unordered_map<u64, std::vector<BasicBlock*>>& table,
+  u64 key,
+  BasicBlock* basic_block
+) {
+  auto match = table.find(key);
+
+  if (match != table.end()) {
+    auto& basic_blocks = match->second;
+
+    basic_blocks.erase(
+      std::remove(basic_blocks.begin(), basic_blocks.end(), basic_block),
+      basic_blocks.end()
+    );
+
+    if (basic_blocks.empty()) {
+      table.erase(match);
+    }
+  }
+}
+
 X64Backend::X64Backend(
   CPU::Descriptor const& descriptor,
   State& state,
-  BasicBlockCache& block_cache,
-  bool const& irq_line
+  BasicBlockCache& block_cache
 )   : memory(descriptor.memory)
     , state(state)
     , coprocessors(descriptor.coprocessors)
-    , block_cache(block_cache)
-    , irq_line(irq_line) {
-  CreateCodeGenerator();
+    , block_cache(block_cache) {
+  CreateCodeGenerator(descriptor.code_buffer_size);
   EmitCallBlock();
+  EmitDispatcher();
 }
 
 X64Backend::~X64Backend() {
-  delete code;
+  // Release all basic blocks while their release callbacks can still access the backend.
+  block_cache.Flush();
+
+  delete prelude_code;
   memory::free(buffer);
 }
 
-void X64Backend::CreateCodeGenerator() {
-  buffer = reinterpret_cast<u8*>(memory::aligned_alloc(4096, kCodeBufferSize));
+void X64Backend::CreateCodeGenerator(size_t code_buffer_size) {
+  // Round up to a multiple of the page size.
+  buffer_size = (code_buffer_size + 4095) & ~size_t(4095);
+
+  if (buffer_size <= kPreludeSize) {
+    throw std::runtime_error(
+      fmt::format("lunatic: code buffer size of {} bytes is too small", code_buffer_size)
+    );
+  }
+
+  buffer = reinterpret_cast<u8*>(memory::aligned_alloc(4096, buffer_size));
 
   if (buffer == nullptr) {
     throw std::runtime_error(
@@ -55,11 +129,21 @@ void X64Backend::CreateCodeGenerator() {
 
   Xbyak::CodeArray::protect(
     buffer,
-    kCodeBufferSize,
+    buffer_size,
     Xbyak::CodeArray::PROTECT_RWE
   );
 
-  code = new Xbyak::CodeGenerator{kCodeBufferSize, buffer};
+  prelude_code = new Xbyak::CodeGenerator{kPreludeSize, buffer};
+  code = prelude_code;
+
+  // Split the rest of the buffer into equally sized regions.
+  auto region_size = (buffer_size - kPreludeSize) / kNumberOfCodeRegions;
+  auto region_begin = buffer + kPreludeSize;
+
+  for (int i = 0; i < kNumberOfCodeRegions; i++) {
+    code_regions.push_back({region_begin, region_begin + region_size, region_begin});
+    region_begin += region_size;
+  }
 }
 
 void X64Backend::EmitCallBlock() {
@@ -75,10 +159,11 @@ void X64Backend::EmitCallBlock() {
   code->mov(rbp, rsp);
 
   code->mov(r12, kRegArg0); // r12 = function pointer
-  code->mov(rbx, kRegArg1); // rbx = cycle counter
 
-  // Load carry flag into AH
   code->mov(rcx, uintptr(&state));
+  code->mov(dword[rcx + state.GetOffsetToCycleCounter()], kRegArg1.cvt32());
+
+  // Load carry flag into AH
   code->mov(edx, dword[rcx + state.GetOffsetToCPSR()]);
   code->bt(edx, 29); // CF = value of bit 29
   code->lahf();
@@ -86,7 +171,8 @@ void X64Backend::EmitCallBlock() {
   code->call(r12);
 
   // Return remaining number of cycles
-  code->mov(rax, rbx);
+  code->mov(rcx, uintptr(&state));
+  code->mov(eax, dword[rcx + state.GetOffsetToCycleCounter()]);
 
   code->add(rsp, stack_displacement);
 #ifdef ABI_MSVC
@@ -100,110 +186,389 @@ void X64Backend::EmitCallBlock() {
 #endif
 }
 
+void X64Backend::EmitDispatcher() {
+  auto label_cache_miss = Xbyak::Label{};
+
+  dispatcher = (uintptr)code->getCurr();
+
+  /* Basic blocks jump here once they checked that cycles are left and no IRQ is pending.
+   * On a cache miss we return to CallBlock and the basic block is compiled by the caller.
+   */
+  EmitBasicBlockDispatch(label_cache_miss);
+
+  code->L(label_cache_miss);
+  code->ret();
+
+#if LUNATIC_USE_VTUNE
+  vtune::ReportDispatcher(reinterpret_cast<u8*>(dispatcher), code->getCurr());
+#endif
+}
+
 void X64Backend::Compile(BasicBlock& basic_block) {
-  try {
-    auto label_return_to_dispatch = Xbyak::Label{};
-    auto opcode_size = basic_block.key.Thumb() ? sizeof(u16) : sizeof(u32);
-    auto number_of_micro_blocks = basic_block.micro_blocks.size();
-
-    basic_block.function = (BasicBlock::CompiledFn)code->getCurr();
-
-    for (size_t i = 0; i < number_of_micro_blocks; i++) {
-      auto const& micro_block = basic_block.micro_blocks[i];
-      auto& emitter  = micro_block.emitter;
-      auto condition = micro_block.condition;
-      auto reg_alloc = X64RegisterAllocator{emitter, *code};
-      auto context   = CompileContext{*code, reg_alloc, state};
-
-      auto label_skip = Xbyak::Label{};
-      auto label_done = Xbyak::Label{};
-
-      // Skip past the micro block if its condition is not met
-      EmitConditionalBranch(condition, label_skip);
-
-      // Compile each IR opcode inside the micro block
-      for (auto const& op : emitter.Code()) {
-        CompileIROp(context, op);
-        reg_alloc.AdvanceLocation();
+  if (CompileIntoFreeList(basic_block)) {
+    LinkBasicBlock(basic_block);
+    return;
+  }
+
+  while (true) {
+    auto& region = code_regions[current_code_region];
+    auto generator = Xbyak::CodeGenerator{size_t(region.end - region.cursor), region.cursor};
+
+    code = &generator;
+
+    try {
+      EmitBasicBlock(basic_block);
+    } catch (Xbyak::Error error) {
+      code = prelude_code;
+
+      if (int(error) != Xbyak::ERR_CODE_IS_TOO_BIG || region.cursor == region.begin) {
+        throw;
       }
 
-      /* Once we reached the end of the basic block,
-       * check if we can emit a jump to an already compiled basic block.
-       * Also update the cycle counter in that case and return to the dispatcher
-       * in the case that we ran out of cycles.
+      /* The current region is full. Continue in the next region
+       * and evict the basic blocks which were compiled into it before.
        */
-      if (basic_block.enable_fast_dispatch && i == number_of_micro_blocks - 1) {
-        auto& branch_target = basic_block.branch_target;
+      current_code_region = (current_code_region + 1) % kNumberOfCodeRegions;
+      EvictCodeRegion(code_regions[current_code_region]);
+      continue;
+    }
 
-        if (branch_target.key.value != 0) {
-          auto target_block = block_cache.Get(branch_target.key);
+    code = prelude_code;
+    region.cursor += generator.getSize();
+    region.keys.push_back(basic_block.key);
+    basic_block.function_size = generator.getSize();
+    break;
+  }
 
-          if (target_block != nullptr) {
-            // Return to the dispatcher if we ran out of cycles.
-            code->sub(rbx, basic_block.length);
-            code->jle(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
+  LinkBasicBlock(basic_block);
+}
 
-            // Return to the dispatcher if there is an IRQ to handle
-            code->mov(rdx, uintptr(&irq_line));
-            code->cmp(byte[rdx], 0);
-            code->jnz(label_return_to_dispatch);
+bool X64Backend::CompileIntoFreeList(BasicBlock& basic_block) {
+  auto estimated_size = kBasicBlockSizeEstimate;
 
-            code->mov(rsi, u64(target_block->function));
-            code->jmp(rsi);
-          }
+  for (auto const& micro_block : basic_block.micro_blocks) {
+    estimated_size += kMicroBlockSizeEstimate + micro_block.emitter.Code().size() * kIROpcodeSizeEstimate;
+  }
+
+  for (auto& region : code_regions) {
+    for (auto it = region.free_list.begin(); it != region.free_list.end(); ++it) {
+      auto [address, size] = *it;
+
+      if (size < estimated_size) {
+        continue;
+      }
+
+      auto generator = Xbyak::CodeGenerator{size, reinterpret_cast<u8*>(address)};
+
+      code = &generator;
+
+      try {
+        EmitBasicBlock(basic_block);
+      } catch (Xbyak::Error error) {
+        code = prelude_code;
+
+        // Let the caller compile the basic block into the current region instead.
+        if (int(error) == Xbyak::ERR_CODE_IS_TOO_BIG) {
+          return false;
         }
+        throw;
       }
 
-      /* The program counter is normally updated via IR opcodes.
-       * But if we skipped past the code which'd do that, we need to manually
-       * update the program counter.
-       */
-      if (condition != Condition::AL) {
-        code->jmp(label_done);
+      code = prelude_code;
+      region.free_list.erase(it);
+      region.keys.push_back(basic_block.key);
+      basic_block.function_size = generator.getSize();
+
+      // Return the unused part of the memory to the free list.
+      if (size > generator.getSize()) {
+        region.free_list[address + generator.getSize()] = size - generator.getSize();
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void X64Backend::EmitBasicBlock(BasicBlock& basic_block) {
+  auto label_return_to_dispatch = Xbyak::Label{};
+  auto opcode_size = basic_block.key.Thumb() ? sizeof(u16) : sizeof(u32);
+  auto number_of_micro_blocks = basic_block.micro_blocks.size();
+  auto& fall_through = basic_block.fall_through;
+
+  basic_block.function = (BasicBlock::CompiledFn)code->getCurr();
+  basic_block.links.clear();
+  host_flags = {};
+  PinGPRs(basic_block);
+
+  auto pinned_host_regs = std::vector<Xbyak::Reg32>{};
+
+  for (auto const& pinned_gpr : pinned_gprs) {
+    pinned_host_regs.push_back(pinned_gpr.host_reg);
+  }
+
+  /* Count the executions of baseline tier basic blocks and return to the dispatcher
+   * before executing anything once the basic block should be recompiled.
+   */
+  if (basic_block.tier == 0) {
+    auto label_cold = Xbyak::Label{};
+
+    code->mov(rdx, uintptr(&basic_block.hotness_counter));
+    code->sub(dword[rdx], 1);
+    code->jnz(label_cold);
+    code->ret();
+    code->L(label_cold);
+  }
+
+  EmitLoadPinnedGPRs();
+
+  for (size_t i = 0; i < number_of_micro_blocks; i++) {
+    auto const& micro_block = basic_block.micro_blocks[i];
+    auto& emitter  = micro_block.emitter;
+    auto condition = micro_block.condition;
+    auto reg_alloc = X64RegisterAllocator{emitter, *code, pinned_host_regs};
+    auto context   = CompileContext{*code, reg_alloc, state};
+
+    auto label_skip = Xbyak::Label{};
+    auto label_done = Xbyak::Label{};
+
+    // Skip past the micro block if its condition is not met
+    EmitConditionalBranch(condition, label_skip);
+
+    auto host_flags_if_skipped = host_flags;
+    auto pinned_gprs_dirty_if_skipped = pinned_gprs_dirty;
 
-        code->L(label_skip);
-        code->add(
-          dword[rcx + state.GetOffsetToGPR(Mode::User, GPR::PC)],
-          micro_block.length * opcode_size
-        );
+    FindLazyFlagUpdates(emitter);
 
-        code->L(label_done);
+    // Compile each IR opcode inside the micro block
+    for (auto const& op : emitter.Code()) {
+      CompileIROp(context, op);
+      reg_alloc.AdvanceLocation();
+    }
+
+    bool exit_if_skipped = basic_block.enable_fast_dispatch &&
+      i == number_of_micro_blocks - 1 && fall_through.key.value != 0;
+
+    // The guest flags and pinned GPRs must be in the state before any exit from the basic block.
+    if ((basic_block.enable_fast_dispatch && i == number_of_micro_blocks - 1) || micro_block.side_exit.key.value != 0) {
+      if (host_flags.dirty) {
+        EmitFlushHostFlags(edx);
+        host_flags.dirty = false;
       }
+
+      EmitStorePinnedGPRs(pinned_gprs_dirty);
+      pinned_gprs_dirty = 0;
     }
 
-    if (basic_block.enable_fast_dispatch) {
-      // Return to the dispatcher if we ran out of cycles.
-      code->sub(rbx, basic_block.length);
-      code->jle(label_return_to_dispatch);
+    /* Once we reached the end of the basic block, emit a patchable jump to the branch target.
+     * The jump initially goes to the dispatcher and is linked directly to the
+     * branch target once it is compiled (see LinkBasicBlock).
+     * Also update the cycle counter and return to the dispatcher
+     * in the case that we ran out of cycles.
+     */
+    if (basic_block.enable_fast_dispatch && i == number_of_micro_blocks - 1) {
+      auto& branch_target = basic_block.branch_target;
+      auto& return_stack = basic_block.return_stack;
+
+      // Remember where a function call at the end of the basic block will return to.
+      if (return_stack.push_key.value != 0) {
+        EmitReturnStackPush(basic_block);
+      }
 
-      // Return to the dispatcher if there is an IRQ to handle
-      code->mov(rdx, uintptr(&irq_line));
-      code->cmp(byte[rdx], 0);
-      code->jnz(label_return_to_dispatch);
+      if (branch_target.idle_loop) {
+        EmitIdleLoopExit();
+      } else if (branch_target.key.value != 0 || return_stack.pop) {
+        // Return to the dispatcher if we ran out of cycles or the host requested an exit.
+        code->sub(dword[rcx + state.GetOffsetToCycleCounter()], basic_block.length);
+        code->jle(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
 
-      // If the next basic block already is compiled then jump to it.
-      EmitBasicBlockDispatch(label_return_to_dispatch);
+        if (return_stack.pop) {
+          EmitReturnStackPop();
+        } else {
+          auto& link = basic_block.links.emplace_back();
+          link.key = branch_target.key;
+          link.patch_location = (uintptr)code->getCurr();
+          link.unlinked_target = dispatcher;
+          code->jmp((void*)dispatcher, Xbyak::CodeGenerator::T_NEAR);
+        }
+      }
+    }
+
+    // Leave the superblock if the micro block ends in a taken branch.
+    if (micro_block.side_exit.key.value != 0) {
+      EmitExit(basic_block, micro_block.side_exit, label_return_to_dispatch);
+
+      // Only the path that skipped the micro block continues.
+      host_flags = host_flags_if_skipped;
+      pinned_gprs_dirty = pinned_gprs_dirty_if_skipped;
+    }
+
+    /* The program counter is normally updated via IR opcodes.
+     * But if we skipped past the code which'd do that, we need to manually
+     * update the program counter.
+     */
+    if (condition != Condition::AL) {
+      bool executed_path_continues = micro_block.side_exit.key.value == 0;
+
+      // Both paths must agree on whether the guest flags still have to be written back when they join.
+      bool keep_dirty = host_flags.dirty && host_flags_if_skipped.dirty && !exit_if_skipped;
+
+      if (executed_path_continues && host_flags.dirty && !keep_dirty) {
+        EmitFlushHostFlags(edx);
+      }
+
+      code->jmp(label_done);
+
+      code->L(label_skip);
+      code->add(
+        dword[rcx + state.GetOffsetToGPR(Mode::User, GPR::PC)],
+        micro_block.length * opcode_size
+      );
 
-      code->L(label_return_to_dispatch);
-      code->ret();
+      if (host_flags_if_skipped.dirty && !keep_dirty) {
+        EmitFlushHostFlags(edx);
+      }
+
+      // Link the not-taken path of a conditional branch at the end of the basic block.
+      if (exit_if_skipped) {
+        EmitStorePinnedGPRs(pinned_gprs_dirty_if_skipped);
+        EmitExit(basic_block, fall_through, label_return_to_dispatch);
+        pinned_gprs_dirty_if_skipped = 0;
+      }
+
+      code->L(label_done);
+
+      host_flags.valid = host_flags.valid && host_flags_if_skipped.valid;
+      host_flags.dirty = keep_dirty;
+      pinned_gprs_dirty |= pinned_gprs_dirty_if_skipped;
+    }
+  }
+
+  if (host_flags.dirty) {
+    EmitFlushHostFlags(edx);
+  }
+
+  EmitStorePinnedGPRs(pinned_gprs_dirty);
+
+  if (basic_block.enable_fast_dispatch) {
+    auto last_condition = basic_block.micro_blocks.back().condition;
+
+    if (fall_through.key.value != 0 && last_condition == Condition::AL) {
+      // The basic block ended because it ran out of instructions, so the next basic block is known.
+      EmitExit(basic_block, fall_through, label_return_to_dispatch);
     } else {
-      code->sub(rbx, basic_block.length);
-      code->ret();
+      // Return to the dispatcher if we ran out of cycles or the host requested an exit.
+      code->sub(dword[rcx + state.GetOffsetToCycleCounter()], basic_block.length);
+      code->jle(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
+
+      // If the next basic block already is compiled then jump to it.
+      EmitInlineCacheDispatch(basic_block, label_return_to_dispatch);
     }
 
+    code->L(label_return_to_dispatch);
+    code->ret();
+  } else {
+    code->sub(dword[rcx + state.GetOffsetToCycleCounter()], basic_block.length);
+    code->ret();
+  }
+
 #if LUNATIC_USE_VTUNE
-    vtune::ReportBasicBlock(basic_block, code->getCurr());
+  vtune::ReportBasicBlock(basic_block, code->getCurr());
 #endif
-  } catch (Xbyak::Error error) {
-    if (int(error) == Xbyak::ERR_CODE_IS_TOO_BIG) {
-      fmt::print("FLUSH\n");
-      block_cache.Flush();
-      code->resetSize();
-      EmitCallBlock();
-      Compile(basic_block);
+}
+
+void X64Backend::EmitExit(
+  BasicBlock& basic_block,
+  BasicBlock::Exit const& exit,
+  Xbyak::Label& label_return_to_dispatch
+) {
+  if (exit.idle_loop) {
+    EmitIdleLoopExit();
+    return;
+  }
+
+  code->sub(dword[rcx + state.GetOffsetToCycleCounter()], exit.length);
+
+  if (!basic_block.enable_fast_dispatch) {
+    code->ret();
+    return;
+  }
+
+  // Return to the dispatcher if we ran out of cycles or the host requested an exit.
+  code->jle(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
+
+  auto& link = basic_block.links.emplace_back();
+  link.key = exit.key;
+  link.patch_location = (uintptr)code->getCurr();
+  link.unlinked_target = dispatcher;
+  code->jmp((void*)dispatcher, Xbyak::CodeGenerator::T_NEAR);
+}
+
+void X64Backend::EmitIdleLoopExit() {
+  /* The loop will spin until the memory it polls changes,
+   * which only can happen once we returned to the host.
+   * So skip the remaining cycles instead of running them.
+   */
+  code->mov(dword[rcx + state.GetOffsetToCycleCounter()], 0);
+  code->ret();
+}
+
+void X64Backend::EvictCodeRegion(CodeRegion& region) {
+  for (auto key : region.keys) {
+    auto basic_block = block_cache.Get(key);
+
+    // The key might have been recompiled into another region since.
+    if (basic_block != nullptr && region.Contains(basic_block->function)) {
+      block_cache.Set(key, nullptr);
+    }
+  }
+
+  region.keys.clear();
+  region.free_list.clear();
+  region.cursor = region.begin;
+}
+
+void X64Backend::ReleaseCode(BasicBlock& basic_block) {
+  auto address = basic_block.function;
+  auto size = basic_block.function_size;
+
+  /* Note that it is safe to release the memory even if the basic block is still running,
+   * since memory is reused only while compiling, which never happens during code execution.
+   */
+  for (auto& region : code_regions) {
+    if (!region.Contains(address)) {
+      continue;
+    }
+
+    auto& free_list = region.free_list;
+
+    // Merge with the preceding free range, if it is adjacent.
+    auto next = free_list.lower_bound(address);
+
+    if (next != free_list.begin()) {
+      auto prev = std::prev(next);
+
+      if (prev->first + prev->second == address) {
+        address = prev->first;
+        size += prev->second;
+        free_list.erase(prev);
+      }
+    }
+
+    // Merge with the following free range, if it is adjacent.
+    if (next != free_list.end() && next->first == address + size) {
+      size += next->second;
+      free_list.erase(next);
+    }
+
+    // Give the memory back to the region if it is at the end of the used memory.
+    if (address + size == uintptr(region.cursor)) {
+      region.cursor = reinterpret_cast<u8*>(address);
     } else {
-      throw;
+      free_list[address] = size;
     }
+    break;
   }
 }
 
@@ -212,11 +577,14 @@ void X64Backend::EmitConditionalBranch(Condition condition, Xbyak::Label& label_
     return;
   }
 
-  // TODO: Keep decompressed flags in eax?
-  code->mov(eax, dword[rcx + state.GetOffsetToCPSR()]);
-  code->shr(eax, 28);
-  code->mov(edx, 0xC101);
-  code->pdep(eax, eax, edx);
+  // Decompress the flags from the CPSR into AX, unless AX still holds them.
+  if (!host_flags.valid) {
+    code->mov(eax, dword[rcx + state.GetOffsetToCPSR()]);
+    code->shr(eax, 28);
+    code->mov(edx, 0xC101);
+    code->pdep(eax, eax, edx);
+    host_flags.valid = true;
+  }
 
   switch (condition) {
     case Condition::EQ:
@@ -287,8 +655,114 @@ void X64Backend::EmitConditionalBranch(Condition condition, Xbyak::Label& label_
   }
 }
 
-void X64Backend::EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss) {
-  // Build the block key from R15 and CPSR.
+void X64Backend::EmitFlushHostFlags(Xbyak::Reg32 scratch_reg) {
+  auto cpsr = dword[rcx + state.GetOffsetToCPSR()];
+
+  // Convert NZCV bits from AX register into the guest format and merge them into the CPSR.
+  code->mov(scratch_reg, 0xC101);
+  code->pext(scratch_reg, eax, scratch_reg);
+  code->shl(scratch_reg, 28);
+  code->and_(cpsr, 0x0FFF'FFFF);
+  code->or_(cpsr, scratch_reg);
+}
+
+void X64Backend::FindLazyFlagUpdates(IREmitter const& emitter) {
+  IRUpdateFlags* update = nullptr;
+
+  lazy_flag_ops.clear();
+
+  /* An NZCV update can stay in AX if its result only is stored to the CPSR
+   * and AX is not overwritten before that. The CPSR then is stored with the old flags,
+   * which are replaced once the flags are written back (see EmitFlushHostFlags).
+   */
+  for (auto op : emitter.Code()) {
+    if (op->GetClass() == IROpcodeClass::UpdateFlags) {
+      update = lunatic_cast<IRUpdateFlags>(op);
+
+      if (!update->flag_n || !update->flag_z || !update->flag_c || !update->flag_v ||
+          emitter.CountReads(update->result.Get()) != 1) {
+        update = nullptr;
+      }
+    } else if (update != nullptr) {
+      if (op->GetClass() == IROpcodeClass::StoreCPSR && op->Reads(update->result.Get())) {
+        lazy_flag_ops.push_back(update);
+        lazy_flag_ops.push_back(op);
+        update = nullptr;
+      } else if (WritesHostFlags(op)) {
+        update = nullptr;
+      }
+    }
+  }
+}
+
+void X64Backend::PinGPRs(BasicBlock const& basic_block) {
+  Xbyak::Reg32 const host_regs[kMaxPinnedGPRs] {r15d, r14d, r13d};
+
+  // Count the accesses to each guest GPR, identified by its location in the state.
+  auto accesses = std::map<uintptr, int>{};
+
+  for (auto const& micro_block : basic_block.micro_blocks) {
+    for (auto op : micro_block.emitter.Code()) {
+      IRGuestReg const* reg = nullptr;
+
+      switch (op->GetClass()) {
+        case IROpcodeClass::LoadGPR: reg = &lunatic_cast<IRLoadGPR>(op)->reg; break;
+        case IROpcodeClass::StoreGPR: reg = &lunatic_cast<IRStoreGPR>(op)->reg; break;
+        default: break;
+      }
+
+      // The program counter is accessed outside of IR opcodes, i.e. when a micro block is skipped.
+      if (reg != nullptr && reg->reg != GPR::PC) {
+        accesses[state.GetOffsetToGPR(reg->mode, reg->reg)]++;
+      }
+    }
+  }
+
+  auto candidates = std::vector<std::pair<int, uintptr>>{};
+
+  for (auto [offset, count] : accesses) {
+    if (count >= kMinPinnedGPRAccesses) {
+      candidates.emplace_back(count, offset);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), std::greater<>{});
+
+  pinned_gprs.clear();
+  pinned_gprs_dirty = 0;
+
+  for (size_t i = 0; i < candidates.size() && i < kMaxPinnedGPRs; i++) {
+    pinned_gprs.push_back({candidates[i].second, host_regs[i]});
+  }
+}
+
+auto X64Backend::FindPinnedGPR(IRGuestReg const& reg) -> int {
+  auto offset = state.GetOffsetToGPR(reg.mode, reg.reg);
+
+  for (size_t i = 0; i < pinned_gprs.size(); i++) {
+    if (pinned_gprs[i].offset == offset) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+void X64Backend::EmitLoadPinnedGPRs() {
+  for (auto const& pinned_gpr : pinned_gprs) {
+    code->mov(pinned_gpr.host_reg, dword[rcx + pinned_gpr.offset]);
+  }
+}
+
+void X64Backend::EmitStorePinnedGPRs(u32 mask) {
+  for (size_t i = 0; i < pinned_gprs.size(); i++) {
+    if (mask & (1 << i)) {
+      code->mov(dword[rcx + pinned_gprs[i].offset], pinned_gprs[i].host_reg);
+    }
+  }
+}
+
+void X64Backend::EmitBasicBlockKey() {
+  // Build the block key from R15 and CPSR into RDX.
   // See frontend/basic_block.hpp
   code->mov(edx, dword[rcx + state.GetOffsetToGPR(Mode::User, GPR::PC)]);
   code->mov(esi, dword[rcx + state.GetOffsetToCPSR()]);
@@ -296,21 +770,189 @@ void X64Backend::EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss) {
   code->and_(esi, 0x3F);
   code->shl(rsi, 31);
   code->or_(rdx, rsi);
+}
 
-  // Hash0 lookup (first level)
-  code->mov(rsi, rdx);
-  code->shr(rsi, 19);
-  code->mov(rdi, uintptr(block_cache.data));
-  code->mov(rdi, qword[rdi + rsi * sizeof(uintptr)]);
-  code->test(rdi, rdi);
-  code->jz(label_cache_miss);
+void X64Backend::EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss) {
+  using Entry = BasicBlockCache::Entry;
+
+  static_assert(sizeof(Entry) == 16, "the code below assumes 16-byte block cache entries");
+
+  auto label_probe = Xbyak::Label{};
+  auto label_found = Xbyak::Label{};
+
+  EmitBasicBlockKey();
+
+  // Hash the block key. See BasicBlockCache::Hash()
+  code->mov(rsi, BasicBlockCache::kHashMultiplier);
+  code->imul(rsi, rdx);
+  code->shr(rsi, 32);
+
+  code->mov(r8, uintptr(&block_cache));
+  code->mov(r9, qword[r8 + offsetof(BasicBlockCache, mask)]);
+  code->mov(r8, qword[r8 + offsetof(BasicBlockCache, entries)]);
+
+  // Probe the hash table until we find the key or an empty slot.
+  code->L(label_probe);
+  code->and_(rsi, r9);
+  code->mov(rdi, rsi);
+  code->shl(rdi, 4);
+  code->cmp(rdx, qword[r8 + rdi + offsetof(Entry, key)]);
+  code->je(label_found);
+  code->cmp(qword[r8 + rdi + offsetof(Entry, key)], 0);
+  code->je(label_cache_miss, Xbyak::CodeGenerator::T_NEAR);
+  code->inc(rsi);
+  code->jmp(label_probe);
+
+  code->L(label_found);
+  code->mov(rdi, qword[r8 + rdi + offsetof(Entry, function)]);
+
+  // Load carry flag into AH
+  code->mov(edx, dword[rcx + state.GetOffsetToCPSR()]);
+  code->bt(edx, 29); // CF = value of bit 29
+  code->lahf();
+
+  code->jmp(rdi);
+}
+
+void X64Backend::EmitInlineCacheDispatch(BasicBlock& basic_block, Xbyak::Label& label_cache_miss) {
+  using InlineCache = BasicBlock::InlineCache;
+  using Entry = InlineCache::Entry;
+
+  auto label_hit = Xbyak::Label{};
+  auto label_jump = Xbyak::Label{};
+
+  EmitBasicBlockKey();
+
+  // Compare the branch target against the most recently seen branch targets.
+  code->mov(rsi, uintptr(&basic_block.inline_cache));
+
+  for (int i = 0; i < InlineCache::kSize; i++) {
+    auto label_next = Xbyak::Label{};
+    auto entry_offset = offsetof(InlineCache, entries) + i * sizeof(Entry);
+
+    code->cmp(rdx, qword[rsi + entry_offset + offsetof(Entry, key)]);
+    code->jnz(label_next);
+    code->mov(rdi, qword[rsi + entry_offset + offsetof(Entry, function)]);
+    code->jmp(label_hit, Xbyak::CodeGenerator::T_NEAR);
+    code->L(label_next);
+  }
+
+  code->inc(qword[rsi + offsetof(InlineCache, misses)]);
+
+  // Megamorphic branches bypass the inline cache and always use the dispatcher.
+  code->cmp(byte[rsi + offsetof(InlineCache, megamorphic)], 0);
+  code->jnz((void*)dispatcher, Xbyak::CodeGenerator::T_NEAR);
+
+  auto stack_offset = 0x28U;
+
+  // Update the inline cache with the branch target (if it is compiled).
+  code->mov(kRegArg2, rdx);
+  code->mov(kRegArg0, uintptr(this));
+  code->mov(kRegArg1, uintptr(&basic_block));
+  code->mov(rax, uintptr(&OnInlineCacheMiss));
+  code->sub(rsp, stack_offset);
+  code->call(rax);
+  code->add(rsp, stack_offset);
+  code->mov(rcx, uintptr(&state));
+  code->test(rax, rax);
+  code->jz(label_cache_miss, Xbyak::CodeGenerator::T_NEAR);
+  code->mov(rdi, rax);
+  code->jmp(label_jump);
+
+  code->L(label_hit);
+  code->inc(qword[rsi + offsetof(InlineCache, hits)]);
+
+  // Load carry flag into AH
+  code->L(label_jump);
+  code->mov(edx, dword[rcx + state.GetOffsetToCPSR()]);
+  code->bt(edx, 29); // CF = value of bit 29
+  code->lahf();
+
+  code->jmp(rdi);
+}
+
+auto X64Backend::OnInlineCacheMiss(X64Backend* backend, BasicBlock* basic_block, u64 key) -> uintptr {
+  auto& inline_cache = basic_block->inline_cache;
+  auto& entries = inline_cache.entries;
+  auto target_block = backend->block_cache.Get(key);
+
+  if (target_block == nullptr) {
+    return 0;
+  }
+
+  if (inline_cache.misses > kInlineCacheMegamorphicThreshold && inline_cache.misses > inline_cache.hits) {
+    inline_cache.megamorphic = true;
+  }
+
+  // Evict the oldest entry and insert the new branch target at the front.
+  auto& oldest_entry = entries[BasicBlock::InlineCache::kSize - 1];
+
+  if (oldest_entry.key.value != 0) {
+    RemoveFromBlockTable(backend->inline_cache_table, oldest_entry.key.value, basic_block);
+  }
+
+  for (int i = BasicBlock::InlineCache::kSize - 1; i > 0; i--) {
+    entries[i] = entries[i - 1];
+  }
+
+  entries[0].key = key;
+  entries[0].function = target_block->function;
+  backend->inline_cache_table[key].push_back(basic_block);
+
+  return target_block->function;
+}
+
+void X64Backend::EmitReturnStackPush(BasicBlock& basic_block) {
+  using Entry = ReturnStackBuffer::Entry;
+
+  static_assert(sizeof(Entry) == 16, "the code below assumes 16-byte return stack entries");
+
+  // Advance to the next entry in the ring buffer.
+  code->mov(rsi, uintptr(&return_stack_buffer));
+  code->mov(edx, dword[rsi + offsetof(ReturnStackBuffer, index)]);
+  code->inc(edx);
+  code->and_(edx, ReturnStackBuffer::kSize - 1);
+  code->mov(dword[rsi + offsetof(ReturnStackBuffer, index)], edx);
+  code->shl(edx, 4);
+  code->lea(rsi, ptr[rsi + rdx + offsetof(ReturnStackBuffer, entries)]);
+
+  code->mov(rdi, basic_block.return_stack.push_key.value);
+  code->mov(qword[rsi + offsetof(Entry, key)], rdi);
+
+  /* Emit a MOV RDI, imm64 which loads the address of the compiled return block.
+   * It initially loads zero and is patched once the return block is compiled.
+   */
+  auto& link = basic_block.links.emplace_back();
+  link.type = BasicBlock::Link::Type::Address;
+  link.key = basic_block.return_stack.push_key;
+  link.patch_location = (uintptr)code->getCurr();
+  code->db(0x48); // REX.W
+  code->db(0xBF); // MOV RDI, imm64
+  code->dq(0);
+
+  code->mov(qword[rsi + offsetof(Entry, function)], rdi);
+}
+
+void X64Backend::EmitReturnStackPop() {
+  using Entry = ReturnStackBuffer::Entry;
+
+  EmitBasicBlockKey();
 
-  // Hash1 lookup (second level)
-  code->and_(edx, 0x7FFFF);
-  code->mov(rdi, qword[rdi + rdx * sizeof(uintptr)]);
+  // Read the current entry and go back to the previous entry in the ring buffer.
+  code->mov(rsi, uintptr(&return_stack_buffer));
+  code->mov(edi, dword[rsi + offsetof(ReturnStackBuffer, index)]);
+  code->lea(r8d, ptr[rdi - 1]);
+  code->and_(r8d, ReturnStackBuffer::kSize - 1);
+  code->mov(dword[rsi + offsetof(ReturnStackBuffer, index)], r8d);
+  code->shl(edi, 4);
+  code->lea(rsi, ptr[rsi + rdi + offsetof(ReturnStackBuffer, entries)]);
+
+  // Verify that the prediction matches the actual return address.
+  code->cmp(rdx, qword[rsi + offsetof(Entry, key)]);
+  code->jnz((void*)dispatcher, Xbyak::CodeGenerator::T_NEAR);
+  code->mov(rdi, qword[rsi + offsetof(Entry, function)]);
   code->test(rdi, rdi);
-  code->jz(label_cache_miss);
-  code->mov(rdi, qword[rdi + offsetof(BasicBlock, function)]);
+  code->jz((void*)dispatcher, Xbyak::CodeGenerator::T_NEAR);
 
   // Load carry flag into AH
   code->mov(edx, dword[rcx + state.GetOffsetToCPSR()]);
@@ -320,61 +962,191 @@ void X64Backend::EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss) {
   code->jmp(rdi);
 }
 
+void X64Backend::LinkBasicBlock(BasicBlock& basic_block) {
+  auto key = basic_block.key.value;
+
+  for (auto& link : basic_block.links) {
+    auto& linking_blocks = block_linking_table[link.key.value];
+
+    if (linking_blocks.empty() || linking_blocks.back() != &basic_block) {
+      linking_blocks.push_back(&basic_block);
+    }
+
+    // Links to this basic block itself are resolved below.
+    if (link.key.value != key) {
+      auto target_block = block_cache.Get(link.key);
+
+      if (target_block != nullptr) {
+        PatchLink(link, target_block);
+      }
+    }
+  }
+
+  // Link the basic blocks which have been waiting for this block to be compiled.
+  auto match = block_linking_table.find(key);
+
+  if (match != block_linking_table.end()) {
+    for (auto linking_block : match->second) {
+      for (auto& link : linking_block->links) {
+        if (link.key.value == key) {
+          PatchLink(link, &basic_block);
+        }
+      }
+    }
+  }
+
+  basic_block.RegisterReleaseCallback([this](BasicBlock& basic_block) {
+    UnlinkBasicBlock(basic_block);
+    ReleaseCode(basic_block);
+  });
+}
+
+void X64Backend::UnlinkBasicBlock(BasicBlock& basic_block) {
+  // Unlink all links that point directly to the basic block.
+  auto match = block_linking_table.find(basic_block.key.value);
+
+  if (match != block_linking_table.end()) {
+    for (auto linking_block : match->second) {
+      for (auto& link : linking_block->links) {
+        if (link.linked_block == &basic_block) {
+          PatchLink(link, nullptr);
+        }
+      }
+    }
+  }
+
+  // Drop inline cache entries which point into the basic block.
+  auto inline_cache_match = inline_cache_table.find(basic_block.key.value);
+
+  if (inline_cache_match != inline_cache_table.end()) {
+    for (auto caching_block : inline_cache_match->second) {
+      for (auto& entry : caching_block->inline_cache.entries) {
+        if (entry.key.value == basic_block.key.value) {
+          entry = {};
+        }
+      }
+    }
+
+    inline_cache_table.erase(inline_cache_match);
+  }
+
+  // Forget about the inline cache entries of the basic block itself.
+  for (auto& entry : basic_block.inline_cache.entries) {
+    if (entry.key.value != 0) {
+      RemoveFromBlockTable(inline_cache_table, entry.key.value, &basic_block);
+    }
+    entry = {};
+  }
+
+  // The basic block might still be running. Make sure it doesn't try to update its inline cache.
+  basic_block.inline_cache.megamorphic = true;
+
+  // Drop return predictions which point into the basic block.
+  for (auto& entry : return_stack_buffer.entries) {
+    if (entry.function == basic_block.function) {
+      entry = {};
+    }
+  }
+
+  // Forget about the links that go out of the basic block.
+  for (auto& link : basic_block.links) {
+    RemoveFromBlockTable(block_linking_table, link.key.value, &basic_block);
+  }
+}
+
+void X64Backend::PatchLink(BasicBlock::Link& link, BasicBlock* target_block) {
+  auto target = target_block != nullptr ? target_block->function : link.unlinked_target;
+
+  switch (link.type) {
+    case BasicBlock::Link::Type::Jump: {
+      auto displacement = s32(target - (link.patch_location + kJumpRel32Size));
+
+      // Overwrite the 32-bit displacement that follows the JMP opcode.
+      std::memcpy((u8*)link.patch_location + 1, &displacement, sizeof(s32));
+      break;
+    }
+    case BasicBlock::Link::Type::Address: {
+      u64 address = target;
+
+      // Overwrite the 64-bit immediate that follows the MOV opcode.
+      std::memcpy((u8*)link.patch_location + kMovImm64OpcodeSize, &address, sizeof(u64));
+      break;
+    }
+  }
+
+  link.linked_block = target_block;
+}
+
 void X64Backend::CompileIROp(
   CompileContext const& context,
-  std::unique_ptr<IROpcode> const& op
+  IROpcode* op
 ) {
+  // Write the guest flags back before the opcode overwrites AX.
+  if (WritesHostFlags(op)) {
+    if (host_flags.dirty) {
+      EmitFlushHostFlags(context.reg_alloc.GetTemporaryHostReg());
+      host_flags.dirty = false;
+    }
+    host_flags.valid = false;
+  }
+
+  // Also write them back before calling into C++ code. AX is preserved around the call.
+  if (host_flags.dirty && CallsIntoHost(op)) {
+    EmitFlushHostFlags(context.reg_alloc.GetTemporaryHostReg());
+    host_flags.dirty = false;
+  }
+
   switch (op->GetClass()) {
     // Context access (compile_context.cpp)
-    case IROpcodeClass::LoadGPR: CompileLoadGPR(context, lunatic_cast<IRLoadGPR>(op.get())); break;
-    case IROpcodeClass::StoreGPR: CompileStoreGPR(context, lunatic_cast<IRStoreGPR>(op.get())); break;
-    case IROpcodeClass::LoadSPSR: CompileLoadSPSR(context, lunatic_cast<IRLoadSPSR>(op.get())); break;
-    case IROpcodeClass::StoreSPSR: CompileStoreSPSR(context, lunatic_cast<IRStoreSPSR>(op.get())); break;
-    case IROpcodeClass::LoadCPSR: CompileLoadCPSR(context, lunatic_cast<IRLoadCPSR>(op.get())); break;
-    case IROpcodeClass::StoreCPSR: CompileStoreCPSR(context, lunatic_cast<IRStoreCPSR>(op.get())); break;
-    case IROpcodeClass::ClearCarry: CompileClearCarry(context, lunatic_cast<IRClearCarry>(op.get())); break;
-    case IROpcodeClass::SetCarry:   CompileSetCarry(context, lunatic_cast<IRSetCarry>(op.get())); break;
-    case IROpcodeClass::UpdateFlags: CompileUpdateFlags(context, lunatic_cast<IRUpdateFlags>(op.get())); break;
-    case IROpcodeClass::UpdateSticky: CompileUpdateSticky(context, lunatic_cast<IRUpdateSticky>(op.get())); break;
+    case IROpcodeClass::LoadGPR: CompileLoadGPR(context, lunatic_cast<IRLoadGPR>(op)); break;
+    case IROpcodeClass::StoreGPR: CompileStoreGPR(context, lunatic_cast<IRStoreGPR>(op)); break;
+    case IROpcodeClass::LoadSPSR: CompileLoadSPSR(context, lunatic_cast<IRLoadSPSR>(op)); break;
+    case IROpcodeClass::StoreSPSR: CompileStoreSPSR(context, lunatic_cast<IRStoreSPSR>(op)); break;
+    case IROpcodeClass::LoadCPSR: CompileLoadCPSR(context, lunatic_cast<IRLoadCPSR>(op)); break;
+    case IROpcodeClass::StoreCPSR: CompileStoreCPSR(context, lunatic_cast<IRStoreCPSR>(op)); break;
+    case IROpcodeClass::ClearCarry: CompileClearCarry(context, lunatic_cast<IRClearCarry>(op)); break;
+    case IROpcodeClass::SetCarry:   CompileSetCarry(context, lunatic_cast<IRSetCarry>(op)); break;
+    case IROpcodeClass::UpdateFlags: CompileUpdateFlags(context, lunatic_cast<IRUpdateFlags>(op)); break;
+    case IROpcodeClass::UpdateSticky: CompileUpdateSticky(context, lunatic_cast<IRUpdateSticky>(op)); break;
     
     // Barrel shifter (compile_shift.cpp)
-    case IROpcodeClass::LSL: CompileLSL(context, lunatic_cast<IRLogicalShiftLeft>(op.get())); break;
-    case IROpcodeClass::LSR: CompileLSR(context, lunatic_cast<IRLogicalShiftRight>(op.get())); break;
-    case IROpcodeClass::ASR: CompileASR(context, lunatic_cast<IRArithmeticShiftRight>(op.get())); break;
-    case IROpcodeClass::ROR: CompileROR(context, lunatic_cast<IRRotateRight>(op.get())); break;
+    case IROpcodeClass::LSL: CompileLSL(context, lunatic_cast<IRLogicalShiftLeft>(op)); break;
+    case IROpcodeClass::LSR: CompileLSR(context, lunatic_cast<IRLogicalShiftRight>(op)); break;
+    case IROpcodeClass::ASR: CompileASR(context, lunatic_cast<IRArithmeticShiftRight>(op)); break;
+    case IROpcodeClass::ROR: CompileROR(context, lunatic_cast<IRRotateRight>(op)); break;
     
     // ALU (compile_alu.cpp)
-    case IROpcodeClass::AND: CompileAND(context, lunatic_cast<IRBitwiseAND>(op.get())); break;
-    case IROpcodeClass::BIC: CompileBIC(context, lunatic_cast<IRBitwiseBIC>(op.get())); break;
-    case IROpcodeClass::EOR: CompileEOR(context, lunatic_cast<IRBitwiseEOR>(op.get())); break;
-    case IROpcodeClass::SUB: CompileSUB(context, lunatic_cast<IRSub>(op.get())); break;
-    case IROpcodeClass::RSB: CompileRSB(context, lunatic_cast<IRRsb>(op.get())); break;
-    case IROpcodeClass::ADD: CompileADD(context, lunatic_cast<IRAdd>(op.get())); break;
-    case IROpcodeClass::ADC: CompileADC(context, lunatic_cast<IRAdc>(op.get())); break;
-    case IROpcodeClass::SBC: CompileSBC(context, lunatic_cast<IRSbc>(op.get())); break;
-    case IROpcodeClass::RSC: CompileRSC(context, lunatic_cast<IRRsc>(op.get())); break;
-    case IROpcodeClass::ORR: CompileORR(context, lunatic_cast<IRBitwiseORR>(op.get())); break;
-    case IROpcodeClass::MOV: CompileMOV(context, lunatic_cast<IRMov>(op.get())); break;
-    case IROpcodeClass::MVN: CompileMVN(context, lunatic_cast<IRMvn>(op.get())); break;
-    case IROpcodeClass::CLZ: CompileCLZ(context, lunatic_cast<IRCountLeadingZeros>(op.get())); break;
-    case IROpcodeClass::QADD: CompileQADD(context, lunatic_cast<IRSaturatingAdd>(op.get())); break;
-    case IROpcodeClass::QSUB: CompileQSUB(context, lunatic_cast<IRSaturatingSub>(op.get())); break;
+    case IROpcodeClass::AND: CompileAND(context, lunatic_cast<IRBitwiseAND>(op)); break;
+    case IROpcodeClass::BIC: CompileBIC(context, lunatic_cast<IRBitwiseBIC>(op)); break;
+    case IROpcodeClass::EOR: CompileEOR(context, lunatic_cast<IRBitwiseEOR>(op)); break;
+    case IROpcodeClass::SUB: CompileSUB(context, lunatic_cast<IRSub>(op)); break;
+    case IROpcodeClass::RSB: CompileRSB(context, lunatic_cast<IRRsb>(op)); break;
+    case IROpcodeClass::ADD: CompileADD(context, lunatic_cast<IRAdd>(op)); break;
+    case IROpcodeClass::ADC: CompileADC(context, lunatic_cast<IRAdc>(op)); break;
+    case IROpcodeClass::SBC: CompileSBC(context, lunatic_cast<IRSbc>(op)); break;
+    case IROpcodeClass::RSC: CompileRSC(context, lunatic_cast<IRRsc>(op)); break;
+    case IROpcodeClass::ORR: CompileORR(context, lunatic_cast<IRBitwiseORR>(op)); break;
+    case IROpcodeClass::MOV: CompileMOV(context, lunatic_cast<IRMov>(op)); break;
+    case IROpcodeClass::MVN: CompileMVN(context, lunatic_cast<IRMvn>(op)); break;
+    case IROpcodeClass::CLZ: CompileCLZ(context, lunatic_cast<IRCountLeadingZeros>(op)); break;
+    case IROpcodeClass::QADD: CompileQADD(context, lunatic_cast<IRSaturatingAdd>(op)); break;
+    case IROpcodeClass::QSUB: CompileQSUB(context, lunatic_cast<IRSaturatingSub>(op)); break;
 
     // Multiply (and accumulate) (compile_multiply.cpp)
-    case IROpcodeClass::MUL: CompileMUL(context, lunatic_cast<IRMultiply>(op.get())); break;
-    case IROpcodeClass::ADD64: CompileADD64(context, lunatic_cast<IRAdd64>(op.get())); break;
+    case IROpcodeClass::MUL: CompileMUL(context, lunatic_cast<IRMultiply>(op)); break;
+    case IROpcodeClass::ADD64: CompileADD64(context, lunatic_cast<IRAdd64>(op)); break;
    
     // Memory read/write (compile_memory.cpp)
-    case IROpcodeClass::MemoryRead: CompileMemoryRead(context, lunatic_cast<IRMemoryRead>(op.get())); break;
-    case IROpcodeClass::MemoryWrite: CompileMemoryWrite(context, lunatic_cast<IRMemoryWrite>(op.get())); break;
+    case IROpcodeClass::MemoryRead: CompileMemoryRead(context, lunatic_cast<IRMemoryRead>(op)); break;
+    case IROpcodeClass::MemoryWrite: CompileMemoryWrite(context, lunatic_cast<IRMemoryWrite>(op)); break;
     
     // Pipeline flush (compile_flush.cpp)
-    case IROpcodeClass::Flush: CompileFlush(context, lunatic_cast<IRFlush>(op.get())); break;
-    case IROpcodeClass::FlushExchange: CompileFlushExchange(context, lunatic_cast<IRFlushExchange>(op.get())); break;
+    case IROpcodeClass::Flush: CompileFlush(context, lunatic_cast<IRFlush>(op)); break;
+    case IROpcodeClass::FlushExchange: CompileFlushExchange(context, lunatic_cast<IRFlushExchange>(op)); break;
 
     // Coprocessor access (compile_coprocessor.cpp)
-    case IROpcodeClass::MRC: CompileMRC(context, lunatic_cast<IRReadCoprocessorRegister>(op.get())); break;
-    case IROpcodeClass::MCR: CompileMCR(context, lunatic_cast<IRWriteCoprocessorRegister>(op.get())); break;
+    case IROpcodeClass::MRC: CompileMRC(context, lunatic_cast<IRReadCoprocessorRegister>(op)); break;
+    case IROpcodeClass::MCR: CompileMCR(context, lunatic_cast<IRWriteCoprocessorRegister>(op)); break;
 
     default: {
       throw std::runtime_error(
@@ -410,8 +1182,9 @@ auto X64Backend::GetUsedHostRegsFromList(
 ) -> std::vector<Xbyak::Reg64> {
   auto regs_used = std::vector<Xbyak::Reg64>{};
 
+  // Temporary host registers are scratch space and are not read after a call.
   for (auto reg : regs) {
-    if (!reg_alloc.IsHostRegFree(reg)) {
+    if (!reg_alloc.IsHostRegFree(reg) && !reg_alloc.IsHostRegTemporary(reg)) {
       regs_used.push_back(reg);
     }
   }
@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <algorithm>
 #include <lunatic/cpu.hpp>
 #include <fmt/format.h>
+#include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "backend/backend.hpp"
@@ -25,8 +28,7 @@ struct X64Backend : Backend {
   X64Backend(
     CPU::Descriptor const& descriptor,
     State& state,
-    BasicBlockCache& block_cache,
-    bool const& irq_line
+    BasicBlockCache& block_cache
   );
 
  ~X64Backend();
@@ -38,7 +40,81 @@ struct X64Backend : Backend {
   }
 
 private:
-  static constexpr size_t kCodeBufferSize = 32 * 1024 * 1024;
+  // Size of the code region that holds CallBlock and the dispatcher
+  static constexpr size_t kPreludeSize = 4096;
+
+  // Number of regions the remaining code buffer is split into for eviction
+  static constexpr int kNumberOfCodeRegions = 8;
+
+  // Rough upper bounds for the code size, used to pick free memory to compile a basic block into
+  static constexpr size_t kBasicBlockSizeEstimate = 512;
+  static constexpr size_t kMicroBlockSizeEstimate = 64;
+  static constexpr size_t kIROpcodeSizeEstimate = 48;
+
+  // Size of a JMP rel32 instruction (opcode + 32-bit displacement)
+  static constexpr int kJumpRel32Size = 5;
+
+  // Size of the REX prefix and opcode of a MOV r64, imm64 instruction
+  static constexpr int kMovImm64OpcodeSize = 2;
+
+  // Maximum number of guest GPRs which are kept in host registers for a whole basic block
+  static constexpr int kMaxPinnedGPRs = 3;
+
+  // Number of accesses within a basic block from which on a guest GPR is kept in a host register
+  static constexpr int kMinPinnedGPRAccesses = 3;
+
+  // Number of inline cache misses after which a mostly mispredicted branch is considered megamorphic
+  static constexpr u64 kInlineCacheMegamorphicThreshold = 64;
+
+  struct ReturnStackBuffer {
+    static constexpr int kSize = 32;
+
+    struct Entry {
+      u64 key;
+      uintptr function;
+    } entries[kSize];
+
+    u32 index = 0;
+  };
+
+  struct CodeRegion {
+    u8* begin;
+    u8* end;
+    u8* cursor;
+
+    // Keys of the basic blocks which have been compiled into this region.
+    std::vector<BasicBlock::Key> keys;
+
+    // Map address to size of ranges of memory that have been released by basic blocks.
+    std::map<uintptr, size_t> free_list;
+
+    bool Contains(uintptr address) const {
+      return address >= uintptr(begin) && address < uintptr(end);
+    }
+  };
+
+  /* Where the guest NZCV flags are kept while a basic block is compiled.
+   * Flag updates are written back into the CPSR lazily: the flags stay in the
+   * host flags register (AX) until the CPSR is read, AX is overwritten or the basic block is left.
+   */
+  struct HostFlags {
+    // AX holds the current guest NZCV flags (the overflow flag in AL).
+    bool valid = false;
+
+    // The NZCV flags in the guest CPSR are outdated and must be written back from AX.
+    bool dirty = false;
+  };
+
+  /* Guest GPR which is kept in a callee-saved host register for the whole basic block.
+   * It is loaded on entry and written back on exit, so calls to memory and coprocessor
+   * handlers need not save it.
+   */
+  struct PinnedGPR {
+    // Offset of the guest register into the state
+    uintptr offset;
+
+    Xbyak::Reg32 host_reg;
+  };
 
   struct CompileContext {
     Xbyak::CodeGenerator& code;
@@ -46,15 +122,46 @@ private:
     State& state;
   };
 
-  void CreateCodeGenerator();
+  void CreateCodeGenerator(size_t code_buffer_size);
   void EmitCallBlock();
+  void EmitDispatcher();
+  void EmitBasicBlock(BasicBlock& basic_block);
+  bool CompileIntoFreeList(BasicBlock& basic_block);
+  void EvictCodeRegion(CodeRegion& region);
+  void ReleaseCode(BasicBlock& basic_block);
 
   void EmitConditionalBranch(Condition condition, Xbyak::Label& label_skip);
+  void EmitFlushHostFlags(Xbyak::Reg32 scratch_reg);
+  void FindLazyFlagUpdates(IREmitter const& emitter);
+  void PinGPRs(BasicBlock const& basic_block);
+  auto FindPinnedGPR(IRGuestReg const& reg) -> int;
+  void EmitLoadPinnedGPRs();
+  void EmitStorePinnedGPRs(u32 mask);
+
+  bool IsLazyFlagOp(IROpcode const* op) const {
+    return std::find(lazy_flag_ops.begin(), lazy_flag_ops.end(), op) != lazy_flag_ops.end();
+  }
+  void EmitExit(
+    BasicBlock& basic_block,
+    BasicBlock::Exit const& exit,
+    Xbyak::Label& label_return_to_dispatch
+  );
+  void EmitIdleLoopExit();
+  void EmitBasicBlockKey();
   void EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss);
+  void EmitReturnStackPush(BasicBlock& basic_block);
+  void EmitReturnStackPop();
+  void EmitInlineCacheDispatch(BasicBlock& basic_block, Xbyak::Label& label_cache_miss);
+
+  static auto OnInlineCacheMiss(X64Backend* backend, BasicBlock* basic_block, u64 key) -> uintptr;
+
+  void LinkBasicBlock(BasicBlock& basic_block);
+  void UnlinkBasicBlock(BasicBlock& basic_block);
+  void PatchLink(BasicBlock::Link& link, BasicBlock* target_block);
 
   void CompileIROp(
     CompileContext const& context,
-    std::unique_ptr<IROpcode> const& op
+    IROpcode* op
   );
 
   void Push(
@@ -114,10 +221,41 @@ private:
   State& state;
   std::array<Coprocessor*, 16> coprocessors;
   BasicBlockCache& block_cache;
-  bool const& irq_line;
   int (*CallBlock)(BasicBlock::CompiledFn, int);
 
+  /// Shared routine which jumps to the next basic block or returns to CallBlock if it isn't compiled.
+  uintptr dispatcher;
+
+  /// Map block key to the basic blocks which have a patchable link to that block.
+  std::unordered_map<u64, std::vector<BasicBlock*>> block_linking_table;
+
+  /// Map block key to the basic blocks which have that block in their inline cache.
+  std::unordered_map<u64, std::vector<BasicBlock*>> inline_cache_table;
+
+  /// Where the guest NZCV flags are kept at the current point of the basic block being compiled.
+  HostFlags host_flags;
+
+  /// Flag updates and the CPSR stores that publish them, which keep the flags in AX (see FindLazyFlagUpdates).
+  std::vector<IROpcode const*> lazy_flag_ops;
+
+  /// Guest GPRs which are kept in host registers in the basic block being compiled.
+  std::vector<PinnedGPR> pinned_gprs;
+
+  /// Bit mask of the pinned GPRs that may hold a value that is newer than the one in the state.
+  u32 pinned_gprs_dirty = 0;
+
+  /// Ring buffer of predicted function return targets.
+  ReturnStackBuffer return_stack_buffer{};
+
   u8* buffer;
+  size_t buffer_size;
+  std::vector<CodeRegion> code_regions;
+  int current_code_region = 0;
+
+  /// Generator for the prelude (CallBlock and the dispatcher)
+  Xbyak::CodeGenerator* prelude_code;
+
+  /// Generator that code is currently emitted with
   Xbyak::CodeGenerator* code;
 };
 
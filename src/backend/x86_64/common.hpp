@@ -59,6 +59,10 @@ inline void WriteWord(Memory& memory, u32 address, Memory::Bus bus, u32 value) {
   memory.WriteWord(address, value, bus);
 }
 
+inline void NotifyCodeWrite(Memory& memory, u32 address, u32 size) {
+  memory.code_write_handler(address, size);
+}
+
 inline auto ReadCoprocessor(Coprocessor* coprocessor, uint opcode1, uint cn, uint cm, uint opcode2) -> u32 {
   return coprocessor->Read(opcode1, cn, cm, opcode2);
 }
@@ -14,14 +14,33 @@ void X64Backend::CompileLoadGPR(CompileContext const& context, IRLoadGPR* op) {
 
   auto address  = rcx + state.GetOffsetToGPR(op->reg.mode, op->reg.reg);
   auto host_reg = reg_alloc.GetVariableHostReg(op->result.Get());
+  auto pinned   = FindPinnedGPR(op->reg);
 
-  code.mov(host_reg, dword[address]);
+  if (pinned != -1) {
+    code.mov(host_reg, pinned_gprs[pinned].host_reg);
+  } else {
+    code.mov(host_reg, dword[address]);
+  }
 }
 
 void X64Backend::CompileStoreGPR(CompileContext const& context, IRStoreGPR* op) {
   DESTRUCTURE_CONTEXT;
 
   auto address = rcx + state.GetOffsetToGPR(op->reg.mode, op->reg.reg);
+  auto pinned  = FindPinnedGPR(op->reg);
+
+  // Pinned GPRs are written back to the state when the basic block is left.
+  if (pinned != -1) {
+    auto pinned_reg = pinned_gprs[pinned].host_reg;
+
+    if (op->value.IsConstant()) {
+      code.mov(pinned_reg, op->value.GetConst().value);
+    } else {
+      code.mov(pinned_reg, reg_alloc.GetVariableHostReg(op->value.GetVar()));
+    }
+    pinned_gprs_dirty |= 1 << pinned;
+    return;
+  }
 
   if (op->value.IsConstant()) {
     code.mov(dword[address], op->value.GetConst().value);
@@ -59,6 +78,12 @@ void X64Backend::CompileLoadCPSR(CompileContext const& context, IRLoadCPSR* op)
   DESTRUCTURE_CONTEXT;
 
   auto address = rcx + state.GetOffsetToCPSR();
+
+  if (host_flags.dirty) {
+    EmitFlushHostFlags(reg_alloc.GetTemporaryHostReg());
+    host_flags.dirty = false;
+  }
+
   auto host_reg = reg_alloc.GetVariableHostReg(op->result.Get());
 
   code.mov(host_reg, dword[address]);
@@ -76,6 +101,13 @@ void X64Backend::CompileStoreCPSR(CompileContext const& context, IRStoreCPSR* op
 
     code.mov(dword[address], host_reg);
   }
+
+  // A lazy flag update leaves the current flags in AX only.
+  if (IsLazyFlagOp(op)) {
+    host_flags = {true, true};
+  } else {
+    host_flags = {false, false};
+  }
 }
 
 } // namespace lunatic::backend
@@ -70,15 +70,17 @@ void X64Backend::CompileMCR(CompileContext const& context, IRWriteCoprocessorReg
   DESTRUCTURE_CONTEXT;
 
   auto regs_saved = GetUsedHostRegsFromList(reg_alloc, {
-    rax, rcx, rdx, r8, r9, r10, r11,
+    rcx, rdx, r8, r9, r10, r11,
 
     #ifdef ABI_SYSV
     rsi, rdi
     #endif
   });
 
-  bool must_align_rsp = (regs_saved.size() % 2) == 0;//1?
+  bool must_align_rsp = (regs_saved.size() % 2) == 1;
 
+  // AX holds the host flags, which must be preserved.
+  code.push(rax);
   Push(code, regs_saved);
 
   if (must_align_rsp) {
@@ -123,6 +125,7 @@ void X64Backend::CompileMCR(CompileContext const& context, IRWriteCoprocessorReg
 #endif
 
   Pop(code, regs_saved);
+  code.pop(rax);
 }
 
 } // namespace lunatic::backend
@@ -29,6 +29,14 @@ void X64Backend::CompileUpdateFlags(CompileContext const& context, IRUpdateFlags
 
   auto result_reg = reg_alloc.GetVariableHostReg(result_var);
 
+  // The flags stay in AX and are written back after the CPSR store (see FindLazyFlagUpdates).
+  if (IsLazyFlagOp(op)) {
+    if (result_reg != input_reg) {
+      code.mov(result_reg, input_reg);
+    }
+    return;
+  }
+
   if (op->flag_n) mask |= 0x80000000;
   if (op->flag_z) mask |= 0x40000000;
   if (op->flag_c) mask |= 0x20000000;
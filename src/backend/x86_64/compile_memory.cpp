@@ -20,8 +20,6 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
   auto label_final = Xbyak::Label{};
   auto pagetable = memory.pagetable.get();
 
-  code.push(rcx);
-
   auto& itcm = memory.itcm;
   auto& dtcm = memory.dtcm;
 
@@ -161,7 +159,7 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
 
   /**
    * Get caller-saved registers that need to be saved.
-   * RCX already has been saved earlier.
+   * RCX is restored from the state address at the end.
    * RAX is handled separately, because we must read the 
    * return value of the called function from it later.
    */
@@ -173,7 +171,7 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
     #endif
   });
 
-  if ((regs_saved.size() % 2) == 0) stack_offset += sizeof(u64);
+  if ((regs_saved.size() % 2) == 1) stack_offset += sizeof(u64);
 
   Push(code, regs_saved);
 
@@ -246,7 +244,8 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
     code.L(label_aligned);
   }
 
-  code.pop(rcx);
+  // RCX always holds the state address, reloading it avoids stack traffic on the fast path.
+  code.mov(rcx, uintptr(&state));
 }
 
 void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite* op) {
@@ -261,7 +260,62 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
   auto label_final = Xbyak::Label{};
   auto pagetable = memory.pagetable.get();
 
-  code.push(rcx);
+  auto code_pages = memory.code_pages;
+
+  // Let the JIT invalidate compiled code before it gets overwritten.
+  if (code_pages != nullptr) {
+    auto label_no_code = Xbyak::Label{};
+
+    // Test the bit of the line in the page's code line mask.
+    code.mov(rcx, u64(code_pages));
+    code.mov(scratch_reg, address_reg);
+    code.shr(scratch_reg, Memory::kPageShift);
+    code.mov(ecx, dword[rcx + scratch_reg.cvt64() * sizeof(u32)]);
+    code.mov(scratch_reg, address_reg);
+    code.shr(scratch_reg, Memory::kCodeLineShift);
+    code.bt(ecx, scratch_reg);
+    code.jnc(label_no_code, Xbyak::CodeGenerator::T_NEAR);
+
+    auto stack_offset = 0x20U;
+
+    // RCX is restored from the state address at the end.
+    auto regs_saved = GetUsedHostRegsFromList(reg_alloc, {
+      rdx, r8, r9, r10, r11,
+
+      #ifdef ABI_SYSV
+      rsi, rdi
+      #endif
+    });
+
+    if ((regs_saved.size() % 2) == 1) stack_offset += sizeof(u64);
+
+    // AX holds the host flags, which may not have been written back to the CPSR yet.
+    code.push(rax);
+    Push(code, regs_saved);
+
+    code.mov(kRegArg1.cvt32(), address_reg);
+
+    if (flags & Word) {
+      code.and_(kRegArg1.cvt32(), ~3);
+      code.mov(kRegArg2.cvt32(), sizeof(u32));
+    } else if (flags & Half) {
+      code.and_(kRegArg1.cvt32(), ~1);
+      code.mov(kRegArg2.cvt32(), sizeof(u16));
+    } else if (flags & Byte) {
+      code.mov(kRegArg2.cvt32(), sizeof(u8));
+    }
+
+    code.mov(kRegArg0, uintptr(&memory));
+    code.mov(rax, uintptr(&NotifyCodeWrite));
+    code.sub(rsp, stack_offset);
+    code.call(rax);
+    code.add(rsp, stack_offset);
+
+    Pop(code, regs_saved);
+    code.pop(rax);
+
+    code.L(label_no_code);
+  }
 
   auto& itcm = memory.itcm;
   auto& dtcm = memory.dtcm;
@@ -375,9 +429,9 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
   auto stack_offset = 0x20U;
 
   // Get caller-saved registers that need to be saved.
-  // RCX already has been saved earlier.
+  // RCX is restored from the state address at the end.
   auto regs_saved = GetUsedHostRegsFromList(reg_alloc, {
-    rax, rdx, r8, r9, r10, r11,
+    rdx, r8, r9, r10, r11,
 
     #ifdef ABI_SYSV
     rsi, rdi
@@ -386,6 +440,7 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
 
   if ((regs_saved.size() % 2) == 1) stack_offset += sizeof(u64);
 
+  code.push(rax);
   Push(code, regs_saved);
 
   if (kRegArg1.cvt32() == source_reg) {
@@ -426,9 +481,10 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
   code.add(rsp, stack_offset);
 
   Pop(code, regs_saved);
+  code.pop(rax);
 
   code.L(label_final);
-  code.pop(rcx);
+  code.mov(rcx, uintptr(&state));
 }
 
 } // namespace lunatic::backend
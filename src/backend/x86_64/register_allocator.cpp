@@ -5,8 +5,12 @@
  * found in the LICENSE file.
  */
 
+#include <algorithm>
+#include <climits>
 #include <iterator>
+#include <unordered_map>
 
+#include "common.hpp"
 #include "register_allocator.hpp"
 
 using namespace lunatic::frontend;
@@ -15,16 +19,44 @@ using namespace Xbyak::util;
 namespace lunatic {
 namespace backend {
 
+static bool IsCalleeSaved(Xbyak::Reg32 reg) {
+  static const Xbyak::Reg32 callee_saved_regs[] = {
+    ebx, r12d, r13d, r14d, r15d,
+
+    #ifdef ABI_MSVC
+    esi, edi
+    #endif
+  };
+
+  auto begin = std::begin(callee_saved_regs);
+  auto end = std::end(callee_saved_regs);
+
+  return std::find(begin, end, reg) != end;
+}
+
+static bool IsCall(IROpcode const* op) {
+  switch (op->GetClass()) {
+    case IROpcodeClass::MemoryRead:
+    case IROpcodeClass::MemoryWrite:
+    case IROpcodeClass::MRC:
+    case IROpcodeClass::MCR:
+      return true;
+    default:
+      return false;
+  }
+}
+
 X64RegisterAllocator::X64RegisterAllocator(
   IREmitter const& emitter,
-  Xbyak::CodeGenerator& code
+  Xbyak::CodeGenerator& code,
+  std::vector<Xbyak::Reg32> const& reserved_host_regs
 ) : emitter(emitter), code(code) {
   // Static allocation:
   //   - rax: host flags via lahf (overflow flag in al)
-  //   - rbx: number of cycles left
   //   - rcx: pointer to guest state (lunatic::frontend::State)
   //   - rbp: pointer to stack frame / spill area.
   free_host_regs = {
+    ebx,
     edx,
     esi,
     edi,
@@ -38,9 +70,16 @@ X64RegisterAllocator::X64RegisterAllocator(
     r15d
   };
 
+  for (auto reg : reserved_host_regs) {
+    free_host_regs.erase(std::remove(free_host_regs.begin(), free_host_regs.end(), reg), free_host_regs.end());
+  }
+
   auto number_of_vars = emitter.Vars().size();
   var_id_to_host_reg.resize(number_of_vars);
   var_id_to_point_of_last_use.resize(number_of_vars);
+  var_id_to_uses.resize(number_of_vars);
+  var_id_to_constant.resize(number_of_vars);
+  var_id_to_evicted.resize(number_of_vars);
   var_id_to_spill_slot.resize(number_of_vars);
 
   EvaluateVariableLifetimes();
@@ -66,11 +105,15 @@ auto X64RegisterAllocator::GetVariableHostReg(IRVariable const& var) -> Xbyak::R
     return maybe_reg.Unwrap();
   }
 
-  auto reg = FindFreeHostReg();
+  // Values that survive a call into C++ code should not need to be saved around it.
+  auto reg = FindFreeHostReg(IsLiveAcrossCall(var));
 
   // If the variable was spilled previously then restore its previous value.
   auto maybe_spill = var_id_to_spill_slot[var.id];
-  if (maybe_spill.HasValue()) {
+  if (var_id_to_evicted[var.id]) {
+    code.mov(reg, var_id_to_constant[var.id].Unwrap());
+    var_id_to_evicted[var.id] = false;
+  } else if (maybe_spill.HasValue()) {
     auto slot = maybe_spill.Unwrap();
     code.mov(reg, dword[rbp + slot * sizeof(u32)]);
     free_spill_bitmap[slot] = false;
@@ -114,36 +157,112 @@ bool X64RegisterAllocator::IsHostRegFree(Xbyak::Reg64 reg) const {
   return std::find(begin, end, reg.cvt32()) != end;
 }
 
+bool X64RegisterAllocator::IsHostRegTemporary(Xbyak::Reg64 reg) const {
+  auto begin = temp_host_regs.begin();
+  auto end = temp_host_regs.end();
+
+  return std::find(begin, end, reg.cvt32()) != end;
+}
+
 void X64RegisterAllocator::EvaluateVariableLifetimes() {
+  std::unordered_map<IROpcode const*, int> op_to_location;
+  int location = 0;
+
+  for (auto op : emitter.Code()) {
+    if (IsCall(op)) {
+      call_locations.push_back(location);
+    }
+    op_to_location[op] = location++;
+  }
+
   for (auto const& var : emitter.Vars()) {
-    int point_of_last_use = -1;
-    int location = 0;
+    auto& uses = var_id_to_uses[var->id];
+    IROpcode* writer = nullptr;
+    bool single_writer = true;
+
+    emitter.VisitUses(*var, [&](IROpcode* op) {
+      auto match = op_to_location.find(op);
 
-    for (auto const& op : emitter.Code()) {
-      if (op->Writes(*var) || op->Reads(*var)) {
-        point_of_last_use = location;
+      // Skip opcodes that aren't part of this program or no longer access the variable.
+      if (match == op_to_location.end() || !(op->Reads(*var) || op->Writes(*var))) {
+        return;
       }
 
-      location++;
+      if (op->Writes(*var)) {
+        if (writer != nullptr && writer != op) {
+          single_writer = false;
+        }
+        writer = op;
+      }
+
+      uses.push_back(match->second);
+    });
+
+    std::sort(uses.begin(), uses.end());
+    uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+
+    var_id_to_point_of_last_use[var->id] = uses.empty() ? -1 : uses.back();
+    vars_by_point_of_last_use.push_back(var->id);
+
+    // A variable that is only ever assigned a constant can be reloaded with a MOV
+    // instead of being stored to the stack when its host register is needed.
+    if (writer != nullptr && single_writer && writer->GetClass() == IROpcodeClass::MOV) {
+      auto mov_op = lunatic_cast<IRMov>(writer);
+
+      if (mov_op->source.IsConstant() && !mov_op->update_host_flags) {
+        var_id_to_constant[var->id] = mov_op->source.GetConst().value;
+      }
     }
+  }
 
-    if (point_of_last_use != -1) {
-      var_id_to_point_of_last_use[var->id] = point_of_last_use;
+  std::sort(
+    vars_by_point_of_last_use.begin(),
+    vars_by_point_of_last_use.end(),
+    [this](int var_id_a, int var_id_b) {
+      return var_id_to_point_of_last_use[var_id_a] < var_id_to_point_of_last_use[var_id_b];
     }
+  );
+}
+
+auto X64RegisterAllocator::GetNextUse(IRVariable const& var) const -> int {
+  auto const& uses = var_id_to_uses[var.id];
+  auto match = std::lower_bound(uses.begin(), uses.end(), location);
+
+  if (match == uses.end()) {
+    return INT_MAX;
   }
+  return *match;
+}
+
+bool X64RegisterAllocator::IsLiveAcrossCall(IRVariable const& var) const {
+  auto match = std::lower_bound(call_locations.begin(), call_locations.end(), location);
+
+  return match != call_locations.end() && *match < var_id_to_point_of_last_use[var.id];
 }
 
 void X64RegisterAllocator::ReleaseDeadVariables() {
-  for (auto const& var : emitter.Vars()) {
-    auto point_of_last_use = var_id_to_point_of_last_use[var->id];
+  // Variables are sorted by the end of their live interval,
+  // so only the ones that expired since the last location are visited.
+  while (next_dead_var < vars_by_point_of_last_use.size()) {
+    auto var_id = vars_by_point_of_last_use[next_dead_var];
 
-    if (location > point_of_last_use) {
-      auto maybe_reg = var_id_to_host_reg[var->id];
-      if (maybe_reg.HasValue()) {
-        free_host_regs.push_back(maybe_reg.Unwrap());
-        var_id_to_host_reg[var->id] = {};
-      }
+    if (var_id_to_point_of_last_use[var_id] >= location) {
+      break;
+    }
+
+    auto maybe_reg = var_id_to_host_reg[var_id];
+    if (maybe_reg.HasValue()) {
+      free_host_regs.push_back(maybe_reg.Unwrap());
+      var_id_to_host_reg[var_id] = {};
     }
+
+    auto maybe_spill = var_id_to_spill_slot[var_id];
+    if (maybe_spill.HasValue()) {
+      free_spill_bitmap[maybe_spill.Unwrap()] = false;
+      var_id_to_spill_slot[var_id] = {};
+    }
+
+    next_dead_var++;
   }
 }
 
@@ -154,41 +273,79 @@ void X64RegisterAllocator::ReleaseTemporaryHostRegs() {
   temp_host_regs.clear();
 }
 
-auto X64RegisterAllocator::FindFreeHostReg() -> Xbyak::Reg32 {
+auto X64RegisterAllocator::FindFreeHostReg(bool callee_saved) -> Xbyak::Reg32 {
   if (free_host_regs.size() != 0) {
-    auto reg = free_host_regs.back();
-    free_host_regs.pop_back();
+    // Keep callee-saved host registers for the values that are live across calls.
+    auto match = std::find_if(free_host_regs.rbegin(), free_host_regs.rend(), [&](Xbyak::Reg32 reg) {
+      return IsCalleeSaved(reg) == callee_saved;
+    });
+
+    if (match == free_host_regs.rend()) {
+      match = free_host_regs.rbegin();
+    }
+
+    auto reg = *match;
+    free_host_regs.erase(std::next(match).base());
     return reg;
   }
 
-  auto const& current_op = *current_op_iter;
+  return SpillVariable();
+}
+
+auto X64RegisterAllocator::SpillVariable() -> Xbyak::Reg32 {
+  IRVariable const* spill_var = nullptr;
+  int spill_var_next_use = -1;
+  bool spill_var_is_constant = false;
 
-  // Find a variable to be spilled and deallocate it.
-  // TODO: think of a smart way to pick which variable/register to spill.
   for (auto const& var : emitter.Vars()) {
-    if (var_id_to_host_reg[var->id].HasValue()) {
-      // Make sure the variable that we spill is not currently used.
-      if (current_op->Reads(*var) || current_op->Writes(*var)) {
-        continue;
-      }
+    if (!var_id_to_host_reg[var->id].HasValue()) {
+      continue;
+    }
 
-      auto reg = var_id_to_host_reg[var->id].Unwrap();
+    auto next_use = GetNextUse(*var);
 
-      var_id_to_host_reg[var->id] = {};
+    // Make sure the variable that we spill is not currently used.
+    if (next_use == location) {
+      continue;
+    }
 
-      // Spill the variable into one of the free slots.
-      for (int slot = 0; slot < kSpillAreaSize; slot++) {
-        if (!free_spill_bitmap[slot]) {
-          code.mov(dword[rbp + slot * sizeof(u32)], reg);
-          free_spill_bitmap[slot] = true;
-          var_id_to_spill_slot[var->id] = slot;
-          return reg;
-        }
-      }
+    bool is_constant = var_id_to_constant[var->id].HasValue();
+
+    // Rematerializing a constant is cheaper than a store and a load,
+    // otherwise spill the variable whose next use is furthest away.
+    if (spill_var == nullptr ||
+        (is_constant && !spill_var_is_constant) ||
+        (is_constant == spill_var_is_constant && next_use > spill_var_next_use)) {
+      spill_var = var;
+      spill_var_next_use = next_use;
+      spill_var_is_constant = is_constant;
+    }
+  }
+
+  if (spill_var == nullptr) {
+    throw std::runtime_error("X64RegisterAllocator: out of registers.");
+  }
+
+  auto reg = var_id_to_host_reg[spill_var->id].Unwrap();
+
+  var_id_to_host_reg[spill_var->id] = {};
+
+  if (spill_var_is_constant) {
+    var_id_to_evicted[spill_var->id] = true;
+    return reg;
+  }
+
+  // Spill the variable into one of the free slots.
+  for (int slot = 0; slot < kSpillAreaSize; slot++) {
+    if (!free_spill_bitmap[slot]) {
+      code.mov(dword[rbp + slot * sizeof(u32)], reg);
+      free_spill_bitmap[slot] = true;
+      var_id_to_spill_slot[spill_var->id] = slot;
+      return reg;
     }
   }
 
-  throw std::runtime_error("X64RegisterAllocator: out of registers and spill space.");
+  throw std::runtime_error("X64RegisterAllocator: out of spill space.");
 }
 
 } // namespace lunatic::backend
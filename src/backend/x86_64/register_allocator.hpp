@@ -20,11 +20,17 @@ namespace backend {
 struct X64RegisterAllocator {
   using IREmitter = lunatic::frontend::IREmitter;
 
-  static constexpr int kSpillAreaSize = 32;
+  static constexpr int kSpillAreaSize = 64;
 
+  /**
+   * @param  emitter             the IR program to allocate registers for
+   * @param  code                the code generator, used to emit spills and restores
+   * @param  reserved_host_regs  host registers which must not be allocated
+   */
   X64RegisterAllocator(
     IREmitter const& emitter,
-    Xbyak::CodeGenerator& code
+    Xbyak::CodeGenerator& code,
+    std::vector<Xbyak::Reg32> const& reserved_host_regs = {}
   );
 
   /**
@@ -65,10 +71,42 @@ struct X64RegisterAllocator {
 
   bool IsHostRegFree(Xbyak::Reg64 reg) const;
 
+  /**
+   * Check if a host register was allocated temporarily for the current opcode.
+   * Temporary host registers don't need to be preserved across function calls.
+   */
+  bool IsHostRegTemporary(Xbyak::Reg64 reg) const;
+
 private:
-  /// Determine when each variable will be dead.
+  /**
+   * Determine the locations at which each variable is accessed,
+   * from which its live interval and its next use are derived.
+   * Also find variables that hold a constant and can be rematerialized.
+   */
   void EvaluateVariableLifetimes();
 
+  /**
+   * Get the next location at or after the current location where a variable is accessed.
+   *
+   * @returns the location or INT_MAX if the variable is not accessed anymore
+   */
+  auto GetNextUse(lunatic::frontend::IRVariable const& var) const -> int;
+
+  /**
+   * Check if a variable must be preserved across an opcode that calls into C++ code,
+   * at or after the current location.
+   */
+  bool IsLiveAcrossCall(lunatic::frontend::IRVariable const& var) const;
+
+  /**
+   * Free the host register of a variable which is not accessed by the current opcode.
+   * The variable that is accessed last is chosen, preferring constants
+   * which can be rematerialized instead of being stored to the stack.
+   *
+   * @returns the host register
+   */
+  auto SpillVariable() -> Xbyak::Reg32;
+
   /// Release host registers allocated to variables that are dead.
   void ReleaseDeadVariables();
 
@@ -80,9 +118,10 @@ private:
    * If no register is free attempt to spill a variable to the stack to
    * free its register up.
    *
+   * @param  callee_saved  whether to prefer a callee-saved over a caller-saved host register
    * @returns the host register
    */
-  auto FindFreeHostReg() -> Xbyak::Reg32;
+  auto FindFreeHostReg(bool callee_saved = false) -> Xbyak::Reg32;
 
   IREmitter const& emitter;
   Xbyak::CodeGenerator& code;
@@ -96,6 +135,24 @@ private:
   /// Map variable to the last location where it's accessed.
   std::vector<int> var_id_to_point_of_last_use;
 
+  /// Map variable to the (sorted) locations where it's accessed.
+  std::vector<std::vector<int>> var_id_to_uses;
+
+  /// IDs of the accessed variables, ordered by the end of their live interval.
+  std::vector<int> vars_by_point_of_last_use;
+
+  /// Index of the first variable in vars_by_point_of_last_use that might still be alive.
+  size_t next_dead_var = 0;
+
+  /// Map variable to the constant it holds (if it is a constant that can be rematerialized).
+  std::vector<Optional<u32>> var_id_to_constant;
+
+  /// Whether a variable was evicted from its host register and must be rematerialized.
+  std::vector<bool> var_id_to_evicted;
+
+  /// Sorted locations of the opcodes that (may) call into C++ code.
+  std::vector<int> call_locations;
+
   /// The set of free/unused spill slots.
   std::bitset<kSpillAreaSize> free_spill_bitmap;
 
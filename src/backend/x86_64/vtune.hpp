@@ -31,6 +31,21 @@ static void ReportCallBlock(u8* codeBegin, const u8* codeEnd) {
   }
 }
 
+static void ReportDispatcher(u8* codeBegin, const u8* codeEnd) {
+  if (iJIT_IsProfilingActive() == iJIT_SAMPLING_ON) {
+    char methodName[] = "lunatic_x64_dispatcher";
+    char moduleName[] = "lunatic-JIT";
+
+    iJIT_Method_Load_V2 jmethod = { 0 };
+    jmethod.method_id = iJIT_GetNewMethodID();
+    jmethod.method_name = methodName;
+    jmethod.method_load_address = static_cast<void*>(codeBegin);
+    jmethod.method_size = static_cast<unsigned int>(codeEnd - codeBegin);
+    jmethod.module_name = moduleName;
+    iJIT_NotifyEvent(iJVM_EVENT_TYPE_METHOD_LOAD_FINISHED_V2, static_cast<void*>(&jmethod));
+  }
+}
+
 static void ReportBasicBlock(lunatic::frontend::BasicBlock& basic_block, const u8* codeEnd) {
   if (iJIT_IsProfilingActive() == iJIT_SAMPLING_ON) {
     auto& key = basic_block.key;
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <lunatic/integer.hpp>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lunatic {
+
+/**
+ * Bump allocator that hands out memory from large chunks.
+ * Objects allocated from the arena are laid out next to each other in allocation order.
+ * They are never released individually and their destructors are not called,
+ * instead all memory is released at once when the arena is destroyed or reset.
+ */
+struct ArenaAllocator {
+  static constexpr size_t kChunkSize = 4096;
+
+  ArenaAllocator() = default;
+  ArenaAllocator(ArenaAllocator const&) = delete;
+  ArenaAllocator& operator=(ArenaAllocator const&) = delete;
+
+  ArenaAllocator(ArenaAllocator&& arena) {
+    operator=(std::move(arena));
+  }
+
+  ArenaAllocator& operator=(ArenaAllocator&& arena) {
+    std::swap(chunks, arena.chunks);
+    std::swap(current, arena.current);
+    std::swap(remaining, arena.remaining);
+    return *this;
+  }
+
+  auto Allocate(size_t size, size_t alignment) -> void* {
+    auto padding = -reinterpret_cast<uintptr>(current) & (alignment - 1);
+
+    if (padding + size > remaining) {
+      auto chunk_size = std::max(size + alignment, kChunkSize);
+
+      chunks.push_back(std::make_unique<u8[]>(chunk_size));
+      current = chunks.back().get();
+      remaining = chunk_size;
+      padding = -reinterpret_cast<uintptr>(current) & (alignment - 1);
+    }
+
+    auto object = current + padding;
+
+    current += padding + size;
+    remaining -= padding + size;
+    return object;
+  }
+
+  template<typename T, typename... Args>
+  auto New(Args&&... args) -> T* {
+    static_assert(std::is_trivially_destructible_v<T>,
+      "ArenaAllocator: objects must be trivially destructible");
+
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  /// Release all objects at once.
+  void Reset() {
+    chunks.clear();
+    current = nullptr;
+    remaining = 0;
+  }
+
+private:
+  std::vector<std::unique_ptr<u8[]>> chunks;
+  u8* current = nullptr;
+  size_t remaining = 0;
+};
+
+} // namespace lunatic
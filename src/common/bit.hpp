@@ -12,6 +12,10 @@
 #include <type_traits>
 #include <lunatic/integer.hpp>
 
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
 namespace bit {
 
 template<typename T>
@@ -37,6 +41,25 @@ constexpr auto rotate_right(T value, uint amount) -> T {
   return (value >> amount) | (value << (bits - amount));
 }
 
+inline auto count_leading_zeros(u32 value) -> uint {
+  if (value == 0)
+    return 32;
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, value);
+  return 31 - index;
+#elif defined(__GNUC__)
+  return __builtin_clz(value);
+#else
+  auto count = 0U;
+  while ((value & 0x8000'0000) == 0) {
+    value <<= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
 namespace detail {
 template<typename T>
 constexpr auto build_pattern_mask(const char* pattern) -> T {
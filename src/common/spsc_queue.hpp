@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace lunatic {
+
+/**
+ * Lock-free bounded queue for exactly one producer thread and one consumer thread.
+ * Neither side ever blocks: Push() fails if the queue is full and Pop() fails if it is empty.
+ */
+template<typename T, size_t capacity>
+struct SPSCQueue {
+  static_assert((capacity & (capacity - 1)) == 0, "SPSCQueue: capacity must be a power of two");
+
+  bool Push(T const& value) {
+    auto tail = this->tail.load(std::memory_order_relaxed);
+
+    if (tail - head.load(std::memory_order_acquire) == capacity) {
+      return false;
+    }
+
+    data[tail & (capacity - 1)] = value;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T& value) {
+    auto head = this->head.load(std::memory_order_relaxed);
+
+    if (head == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    value = data[head & (capacity - 1)];
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool IsEmpty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+
+private:
+  std::array<T, capacity> data;
+
+  // Keep the producer and consumer indices on separate cache lines.
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) std::atomic<size_t> tail = 0;
+};
+
+} // namespace lunatic
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <lunatic/cpu.hpp>
+
+#include "frontend/state.hpp"
+
+namespace lunatic {
+
+/**
+ * Implements the parts of the CPU interface that do not depend on how guest code is executed:
+ * register access, IRQ delivery and the cycle budget.
+ * Derived classes only need to execute guest code, see Dispatch().
+ */
+struct CPUBase : CPU {
+  CPUBase(CPU::Descriptor const& descriptor)
+      : exception_base(descriptor.exception_base) {
+  }
+
+  void Reset() override {
+    irq_line = false;
+    wait_for_irq = false;
+    exit_requested = false;
+    cycles_to_run = 0;
+    cycles_deferred = 0;
+    state.Reset();
+    SetGPR(GPR::PC, exception_base);
+  }
+
+  auto IRQLine() const -> bool override {
+    return irq_line;
+  }
+
+  void SetIRQLine(bool level) override {
+    irq_line = level;
+
+    if (level) {
+      StopExecution();
+    }
+  }
+
+  void RequestExit() override {
+    exit_requested = true;
+    StopExecution();
+  }
+
+  auto WaitForIRQ() -> bool& override {
+    return wait_for_irq;
+  }
+
+  auto Run(int cycles) -> int override {
+    if (WaitForIRQ() && !IRQLine()) {
+      return 0;
+    }
+
+    cycles_to_run += cycles;
+
+    int cycles_available = cycles_to_run;
+
+    while (cycles_to_run > 0) {
+      if (IRQLine()) {
+        SignalIRQ();
+      }
+
+      cycles_to_run = Dispatch(cycles_to_run) + cycles_deferred;
+      cycles_deferred = 0;
+      state.GetCycleCounter() = 0;
+
+      if (exit_requested) {
+        exit_requested = false;
+        break;
+      }
+
+      if (WaitForIRQ()) {
+        int cycles_executed = cycles_available - cycles_to_run;
+        cycles_to_run = 0;
+        return cycles_executed;
+      }
+    }
+
+    return cycles_available - cycles_to_run;
+  }
+
+  auto GetGPR(GPR reg) const -> u32 override {
+    return GetGPR(reg, GetCPSR().f.mode);
+  }
+
+  auto GetGPR(GPR reg, Mode mode) const -> u32 override {
+    return const_cast<CPUBase*>(this)->GetGPR(reg, mode);
+  }
+
+  auto GetCPSR() const -> StatusRegister override {
+    return const_cast<CPUBase*>(this)->GetCPSR();
+  }
+
+  auto GetSPSR(Mode mode) const -> StatusRegister override {
+    return const_cast<CPUBase*>(this)->GetSPSR(mode);
+  }
+
+  void SetGPR(GPR reg, u32 value) override {
+    SetGPR(reg, state.GetCPSR().f.mode, value);
+  }
+
+  void SetGPR(GPR reg, Mode mode, u32 value) override {
+    state.GetGPR(mode, reg) = value;
+
+    if (reg == GPR::PC) {
+      if (GetCPSR().f.thumb) {
+        state.GetGPR(mode, GPR::PC) += sizeof(u16) * 2;
+      } else {
+        state.GetGPR(mode, GPR::PC) += sizeof(u32) * 2;
+      }
+    }
+  }
+
+  void SetCPSR(StatusRegister value) override {
+    state.GetCPSR() = value;
+  }
+
+  void SetSPSR(Mode mode, StatusRegister value) override {
+    *state.GetPointerToSPSR(mode) = value;
+  }
+
+protected:
+  /**
+   * Execute guest code starting at the current PC.
+   * Must return once the cycle counter in the state is zero or below,
+   * but may return earlier, i.e. at the end of a basic block.
+   *
+   * @param  cycles  the number of cycles to run at most
+   * @returns the number of cycles left
+   */
+  virtual auto Dispatch(int cycles) -> int = 0;
+
+  /* Guest code returns to the dispatcher once the cycle counter is zero or below.
+   * Make it return at the next basic block boundary by zeroing the counter,
+   * but remember the remaining cycles so that they can still be run.
+   */
+  void StopExecution() {
+    auto& cycle_counter = state.GetCycleCounter();
+
+    if (cycle_counter > 0) {
+      cycles_deferred += cycle_counter;
+      cycle_counter = 0;
+    }
+  }
+
+  void SignalIRQ() {
+    auto& cpsr = GetCPSR();
+
+    wait_for_irq = false;
+
+    if (!cpsr.f.mask_irq) {
+      GetSPSR(Mode::IRQ) = cpsr;
+
+      cpsr.f.mode = Mode::IRQ;
+      cpsr.f.mask_irq = 1;
+      if (cpsr.f.thumb) {
+        GetGPR(GPR::LR) = GetGPR(GPR::PC);
+      } else {
+        GetGPR(GPR::LR) = GetGPR(GPR::PC) - 4;
+      }
+      cpsr.f.thumb = 0;
+
+      GetGPR(GPR::PC) = exception_base + 0x18 + sizeof(u32) * 2;
+    }
+  }
+
+  auto GetGPR(GPR reg) -> u32& {
+    return GetGPR(reg, GetCPSR().f.mode);
+  }
+
+  auto GetGPR(GPR reg, Mode mode) -> u32& {
+    return state.GetGPR(mode, reg);
+  }
+
+  auto GetCPSR() -> StatusRegister& {
+    return state.GetCPSR();
+  }
+
+  auto GetSPSR(Mode mode) -> StatusRegister& {
+    return *state.GetPointerToSPSR(mode);
+  }
+
+  bool irq_line = false;
+  bool wait_for_irq = false;
+  bool exit_requested = false;
+  int cycles_to_run = 0;
+  int cycles_deferred = 0;
+  u32 exception_base;
+  frontend::State state;
+};
+
+} // namespace lunatic
@@ -7,10 +7,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <lunatic/integer.hpp>
 #include <vector>
 
-#include "common/pool_allocator.hpp"
 #include "decode/definition/common.hpp"
 #include "ir/emitter.hpp"
 #include "state.hpp"
@@ -18,8 +19,9 @@
 namespace lunatic {
 namespace frontend {
 
-struct BasicBlock : PoolObject {
+struct BasicBlock {
   using CompiledFn = uintptr;
+  using ReleaseCallback = std::function<void(BasicBlock&)>;
 
   union Key {
     Key() {}
@@ -54,15 +56,103 @@ struct BasicBlock : PoolObject {
   BasicBlock(Key key) : key(key) {}
 
  ~BasicBlock() {
-    // TODO: release the underlying JIT memory.
+    Release();
+  }
+
+  /**
+   * Register a function to be called when the basic block is released.
+   * This allows i.e. the backend to unlink compiled code that refers to this basic block
+   * and to reclaim the memory of the compiled code.
+   *
+   * @param  callback  the function to call
+   */
+  void RegisterReleaseCallback(ReleaseCallback callback) {
+    release_callbacks.push_back(std::move(callback));
+  }
+
+  /**
+   * Call the release callbacks, if that did not happen already.
+   * The basic block must not be executed anymore afterwards.
+   */
+  void Release() {
+    for (auto& callback : release_callbacks) {
+      callback(*this);
+    }
+    release_callbacks.clear();
+  }
+
+  /**
+   * Record that the basic block was translated from the guest memory at [address, address + size).
+   *
+   * @param  address  the first address
+   * @param  size     the number of bytes
+   */
+  void AddAddressRange(u32 address, u32 size) {
+    auto address_hi = address + size - 1;
+
+    if (!address_ranges.empty()) {
+      auto& range = address_ranges.back();
+
+      if (address >= range.lo && address <= range.hi + 1) {
+        range.hi = std::max(range.hi, address_hi);
+        return;
+      }
+    }
+
+    address_ranges.push_back({address, address_hi});
+  }
+
+  /**
+   * Check if the basic block was translated from any guest memory within [address_lo, address_hi].
+   */
+  bool Overlaps(u32 address_lo, u32 address_hi) const {
+    for (auto const& range : address_ranges) {
+      if (range.lo <= address_hi && range.hi >= address_lo) {
+        return true;
+      }
+    }
+    return false;
   }
 
   int length = 0;
 
+  // Ranges of guest memory (inclusive) that the basic block was translated from.
+  struct AddressRange {
+    u32 lo;
+    u32 hi;
+  };
+
+  std::vector<AddressRange> address_ranges;
+
+  // An opcode as it was read from guest memory by the translator.
+  struct Fetch {
+    u32 address;
+    u32 opcode;
+  };
+
+  /* Opcodes that the basic block was translated from, in the order they were read.
+   * Used to detect guest writes which happened while the basic block was compiled in the background.
+   */
+  std::vector<Fetch> fetches;
+
+  // Exit to a basic block which is known at compile time.
+  struct Exit {
+    Key key{};
+
+    // Number of instructions in the basic block up to and including the exit.
+    int length = 0;
+
+    // Whether the exit closes a loop without side effects (see BranchTarget::idle_loop).
+    bool idle_loop = false;
+  };
+
   struct MicroBlock {
     Condition condition;
     IREmitter emitter;
     int length = 0;
+
+    // Exit from a superblock, taken once the micro block was executed.
+    Exit side_exit;
   };
 
   std::vector<MicroBlock> micro_blocks;
@@ -70,14 +160,87 @@ struct BasicBlock : PoolObject {
   // Pointer to the compiled code.
   CompiledFn function = CompiledFn(nullptr);
 
+  // Size of the compiled code in bytes.
+  size_t function_size = 0;
+
   // TODO: clean this up
   struct BranchTarget {
     Key key{};
+
+    /* Whether the branch goes back to the start of the basic block
+     * and the loop that it forms has no side effects, except for memory reads.
+     * Such a loop can only be left when the memory it reads changes,
+     * so the remaining cycles may be skipped.
+     */
+    bool idle_loop = false;
   } branch_target;
 
+  /* Exit taken when the end of the basic block is reached without a taken branch,
+   * that is if the instruction budget ran out or the final (conditional) instruction was skipped.
+   */
+  Exit fall_through;
+
+  // Hints for the return stack buffer, which predicts the target of function returns.
+  struct ReturnStack {
+    // Key of the basic block that a function call at the end of this basic block returns to.
+    Key push_key{};
+
+    // Whether this basic block ends with a (likely) function return.
+    bool pop = false;
+  } return_stack;
+
+  // Inline cache which predicts the target of the indirect branch at the end of the basic block.
+  struct InlineCache {
+    static constexpr int kSize = 2;
+
+    struct Entry {
+      Key key{};
+      uintptr function = 0;
+    } entries[kSize];
+
+    // Counted by the emitted code, to detect megamorphic branches and for BasicBlockCache::GetStatistics().
+    u64 hits = 0;
+    u64 misses = 0;
+
+    // Set once the branch has too many different targets to be cached effectively.
+    bool megamorphic = false;
+  } inline_cache;
+
+  // Patchable code that can be linked directly to another basic block.
+  struct Link {
+    enum class Type {
+      // JMP rel32 to the basic block
+      Jump,
+      // MOV r64, imm64 which loads the address of the basic block
+      Address
+    } type = Type::Jump;
+
+    // Key of the basic block to link to.
+    Key key{};
+
+    // Location of the patchable instruction inside the compiled code.
+    uintptr patch_location = 0;
+
+    // Where the link points to while it is not linked to a compiled basic block.
+    uintptr unlinked_target = 0;
+
+    // The basic block the link currently points to (if any).
+    BasicBlock* linked_block = nullptr;
+  };
+
+  std::vector<Link> links;
+
+  /* Basic blocks are first compiled quickly with the baseline tier (0)
+   * and are recompiled with the optimizing tier (1) once they are executed often.
+   */
+  int tier = 0;
+
+  // Number of executions left until a baseline tier basic block asks to be recompiled.
+  u32 hotness_counter = 0;
 
-  u32 hash = 0;
   bool enable_fast_dispatch = true;
+
+  std::vector<ReleaseCallback> release_callbacks;
 };
 
 } // namespace lunatic::frontend
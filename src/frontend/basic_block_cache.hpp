@@ -7,64 +7,493 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <lunatic/memory.hpp>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "basic_block.hpp"
 
 namespace lunatic {
 namespace frontend {
 
+/**
+ * Maps block keys to basic blocks using an open-addressed hash table with linear probing.
+ * The compiled code pointer is stored inline with the key,
+ * so that emitted code can dispatch to a basic block with a single cache line access.
+ */
 struct BasicBlockCache {
+  static constexpr size_t kInitialCapacity = 4096;
+  static constexpr u64 kHashMultiplier = 0x9E3779B97F4A7C15ULL;
+  static constexpr size_t kNumberOfPages = size_t(1) << (32 - Memory::kPageShift);
+
+  struct Entry {
+    // A key of zero marks an empty slot. Valid keys always have a non-zero CPU mode.
+    u64 key = 0;
+    uintptr function = 0;
+  };
+
+  struct Statistics {
+    size_t capacity;
+    size_t size;
+    size_t footprint;
+    float average_probe_length;
+    int max_probe_length;
+
+    // Inline caches of the indirect branches at the end of the basic blocks.
+    u64 inline_cache_hits;
+    u64 inline_cache_misses;
+    size_t megamorphic_branches;
+  };
+
+  explicit BasicBlockCache(Memory& memory) : memory(&memory) {
+    Allocate(kInitialCapacity);
+    code_pages = std::make_unique<std::array<u32, kNumberOfPages>>();
+    line_masks = std::make_unique<std::array<u32, kNumberOfPages>>();
+  }
+
+  BasicBlockCache(BasicBlockCache const&) = delete;
+
+ ~BasicBlockCache() {
+    basic_blocks.reset();
+    delete[] entries;
+  }
+
   void Flush() {
-    for (int i = 0; i < 0x40000; i++) {
-      data[i] = {};
+    auto capacity = size_t(mask + 1);
+
+    // Every basic block is released, so clear the page index at once instead of per basic block.
+    pages.clear();
+    code_pages->fill(0);
+    line_masks->fill(0);
+
+    for (size_t slot = 0; slot < capacity; slot++) {
+      Release(std::move(basic_blocks[slot]));
     }
+
+    // Pick up changes to the page table.
+    page_table_aliases.clear();
+    page_table_aliases_valid = false;
+
+    delete[] entries;
+    Allocate(kInitialCapacity);
+  }
+
+  /**
+   * Invalidate the basic blocks which were translated from the memory that a guest write modifies,
+   * including basic blocks which were translated from a mirror of that memory.
+   *
+   * @param  address  the address of the write
+   * @param  size     the size of the write in bytes, the write must not cross a page boundary
+   */
+  void FlushWrite(u32 address, u32 size) {
+    auto offset = address & Memory::kPageMask;
+
+    ForEachAlias(address >> Memory::kPageShift, [&](u32 page) {
+      auto address_lo = (page << Memory::kPageShift) | offset;
+
+      Flush(address_lo, address_lo + size - 1);
+    });
   }
 
   void Flush(u32 address_lo, u32 address_hi) {
-    // bits  0 - 30: address[31:1]
-    // bits 31 - 35: CPU mode
-    // bit       36: thumb-flag
-    address_lo >>= 1;
-    address_hi >>= 1;
-
-    // TODO: there probably is a faster way to implement this.
-    for (u64 status = 0; status <= 63; status++) {
-      for (u32 address = address_lo; address <= address_hi; address++) {
-        auto key = BasicBlock::Key{(status << 31) | address};
-        if (Get(key)) {
-          Set(key, nullptr);
+    auto page_lo = address_lo >> Memory::kPageShift;
+    auto page_hi = address_hi >> Memory::kPageShift;
+    auto keys = std::vector<BasicBlock::Key>{};
+
+    auto collect_keys = [&](std::vector<BasicBlock*> const& basic_blocks) {
+      for (auto basic_block : basic_blocks) {
+        if (basic_block->Overlaps(address_lo, address_hi)) {
+          keys.push_back(basic_block->key);
+        }
+      }
+    };
+
+    // Collect the basic blocks first, because removing them modifies the page index.
+    if (page_hi - page_lo >= pages.size()) {
+      for (auto const& [page, basic_blocks] : pages) {
+        if (page >= page_lo && page <= page_hi) {
+          collect_keys(basic_blocks);
+        }
+      }
+    } else {
+      for (u64 page = page_lo; page <= page_hi; page++) {
+        auto match = pages.find(u32(page));
+
+        if (match != pages.end()) {
+          collect_keys(match->second);
         }
       }
     }
+
+    // A basic block which spans multiple pages may have been collected multiple times.
+    for (auto key : keys) {
+      if (Get(key)) {
+        Set(key, nullptr);
+      }
+    }
   }
 
   auto Get(BasicBlock::Key key) const -> BasicBlock* {
-    auto& table = data[key.value >> 19];
-    if (table == nullptr) {
+    auto slot = Find(key.value);
+    if (entries[slot].key == 0) {
       return nullptr;
     }
-    return table->data[key.value & 0x7FFFF].get();
+    return basic_blocks[slot].get();
   }
 
   void Set(BasicBlock::Key key, BasicBlock* block) {
-    auto hash0 = key.value >> 19;
-    auto hash1 = key.value & 0x7FFFF;
-    auto& table = data[hash0];
+    auto slot = Find(key.value);
 
-    if (table == nullptr) {
-      data[hash0] = std::make_unique<Table>();
+    // TODO: pass basic block as std::unique_ptr?
+    Release(std::move(basic_blocks[slot]));
+
+    if (block != nullptr) {
+      AddToPageIndex(block);
     }
 
-    // TODO: pass basic block as std::unique_ptr?
-    table->data[hash1] = std::unique_ptr<BasicBlock>{block};
+    if (block == nullptr) {
+      if (entries[slot].key != 0) {
+        Remove(slot);
+      }
+    } else {
+      if (entries[slot].key == 0) {
+        if ((size + 1) * 2 > size_t(mask + 1)) {
+          Grow();
+          slot = Find(key.value);
+        }
+        size++;
+      }
+      entries[slot].key = key.value;
+      entries[slot].function = block->function;
+      basic_blocks[slot] = std::unique_ptr<BasicBlock>{block};
+    }
   }
 
-  struct Table {
-    // int use_count = 0;
-    std::unique_ptr<BasicBlock> data[0x80000];
-  };
+  /**
+   * Delete the basic blocks which have been released since the last call.
+   * This must only be called while no compiled code is being executed.
+   */
+  void DeleteReleasedBlocks() {
+    released_blocks.clear();
+  }
+
+  auto GetStatistics() const -> Statistics {
+    auto capacity = size_t(mask + 1);
+    auto total_probe_length = size_t(0);
+    auto max_probe_length = 0;
+    auto inline_cache_hits = u64(0);
+    auto inline_cache_misses = u64(0);
+    auto megamorphic_branches = size_t(0);
+
+    for (size_t slot = 0; slot < capacity; slot++) {
+      if (entries[slot].key != 0) {
+        auto probe_length = int(((slot - Hash(entries[slot].key)) & mask) + 1);
+        auto const& inline_cache = basic_blocks[slot]->inline_cache;
+
+        total_probe_length += probe_length;
+        max_probe_length = std::max(max_probe_length, probe_length);
+
+        inline_cache_hits += inline_cache.hits;
+        inline_cache_misses += inline_cache.misses;
+        if (inline_cache.megamorphic) {
+          megamorphic_branches++;
+        }
+      }
+    }
+
+    return {
+      .capacity = capacity,
+      .size = size,
+      .footprint = sizeof(BasicBlockCache) + capacity * (sizeof(Entry) + sizeof(std::unique_ptr<BasicBlock>)),
+      .average_probe_length = size == 0 ? 0.0f : float(total_probe_length) / size,
+      .max_probe_length = max_probe_length,
+      .inline_cache_hits = inline_cache_hits,
+      .inline_cache_misses = inline_cache_misses,
+      .megamorphic_branches = megamorphic_branches
+    };
+  }
+
+  static auto Hash(u64 key) -> u64 {
+    return (key * kHashMultiplier) >> 32;
+  }
+
+  // The layout of these fields is relied upon by the emitted dispatch code.
+  Entry* entries = nullptr;
+  u64 mask = 0;
+
+  size_t size = 0;
+  std::unique_ptr<std::unique_ptr<BasicBlock>[]> basic_blocks;
+
+  /* Basic blocks may be removed from the cache while their code is running,
+   * for example when a memory write handler invalidates a range of code.
+   * The blocks are released immediately, but deleted only once no code is running.
+   */
+  std::vector<std::unique_ptr<BasicBlock>> released_blocks;
+
+  /// Map guest memory page to the basic blocks which were translated from it.
+  std::unordered_map<u32, std::vector<BasicBlock*>> pages;
+
+  /**
+   * For each guest memory page a mask of the 128-byte lines which basic blocks were translated from,
+   * either via the page itself or via a page that mirrors the same memory.
+   * Only writes to these lines need to invalidate basic blocks.
+   */
+  std::unique_ptr<std::array<u32, kNumberOfPages>> code_pages;
+
+  /// For each guest memory page a mask of the 128-byte lines which basic blocks were translated from via that page.
+  std::unique_ptr<std::array<u32, kNumberOfPages>> line_masks;
 
-  // TODO: better manage the lifetimes of the tables.
-  std::unique_ptr<Table> data[0x40000];
+  /// Map host memory to the guest memory pages that the page table maps to it, if there are multiple.
+  std::unordered_map<u8 const*, std::vector<u32>> page_table_aliases;
+  bool page_table_aliases_valid = false;
+
+  Memory* memory;
+
+private:
+  /// Get the host memory that writes to a guest memory page go to, if any.
+  auto GetHostPage(u32 page) const -> u8 const* {
+    auto address = page << Memory::kPageShift;
+
+    // The TCMs take priority over the page table.
+    for (auto tcm : {&memory->itcm, &memory->dtcm}) {
+      auto& config = tcm->config;
+
+      if (tcm->data != nullptr && config.enable && address >= config.base && address <= config.limit) {
+        return tcm->data + ((address - config.base) & tcm->mask & ~u32(Memory::kPageMask));
+      }
+    }
+
+    if (memory->pagetable == nullptr) {
+      return nullptr;
+    }
+    return (*memory->pagetable)[page];
+  }
+
+  void BuildPageTableAliases() {
+    page_table_aliases.clear();
+
+    if (memory->pagetable != nullptr) {
+      auto& pagetable = *memory->pagetable;
+
+      for (u32 page = 0; page < kNumberOfPages; page++) {
+        if (pagetable[page] != nullptr) {
+          page_table_aliases[pagetable[page]].push_back(page);
+        }
+      }
+
+      for (auto it = page_table_aliases.begin(); it != page_table_aliases.end();) {
+        if (it->second.size() == 1) {
+          it = page_table_aliases.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    page_table_aliases_valid = true;
+  }
+
+  /**
+   * Call the functor with a guest memory page and with each page that mirrors the same memory,
+   * that is mirrors within the TCMs and pages which the page table maps to the same host memory.
+   * The page table is assumed to not change until the next full flush.
+   */
+  template<typename Functor>
+  void ForEachAlias(u32 page, Functor&& functor) {
+    auto host_page = GetHostPage(page);
+
+    functor(page);
+
+    if (host_page == nullptr) {
+      return;
+    }
+
+    auto address = page << Memory::kPageShift;
+
+    for (auto tcm : {&memory->itcm, &memory->dtcm}) {
+      auto& config = tcm->config;
+
+      if (tcm->data != nullptr && config.enable && address >= config.base && address <= config.limit) {
+        auto mirror_size = std::max(u64(tcm->mask) + 1, u64(1) << Memory::kPageShift);
+
+        for (u64 mirror = config.base + (address - config.base) % mirror_size; mirror <= config.limit; mirror += mirror_size) {
+          if ((mirror >> Memory::kPageShift) != page) {
+            functor(u32(mirror >> Memory::kPageShift));
+          }
+        }
+      }
+    }
+
+    if (!page_table_aliases_valid) {
+      BuildPageTableAliases();
+    }
+
+    auto match = page_table_aliases.find(host_page);
+
+    if (match != page_table_aliases.end()) {
+      for (auto alias : match->second) {
+        if (alias != page) {
+          functor(alias);
+        }
+      }
+    }
+  }
+
+  // A write to any mirror of a page modifies the same memory, so combine the lines of all mirrors.
+  void UpdateCodePage(u32 page) {
+    auto line_mask = 0U;
+
+    ForEachAlias(page, [&](u32 alias) { line_mask |= (*line_masks)[alias]; });
+    ForEachAlias(page, [&](u32 alias) { (*code_pages)[alias] = line_mask; });
+  }
+
+  void Release(std::unique_ptr<BasicBlock> block) {
+    if (block != nullptr) {
+      RemoveFromPageIndex(block.get());
+      block->Release();
+      released_blocks.push_back(std::move(block));
+    }
+  }
+
+  // Call the functor with each page a basic block overlaps and the mask of the lines it overlaps within the page.
+  template<typename Functor>
+  void ForEachPage(BasicBlock* block, Functor&& functor) {
+    for (auto const& range : block->address_ranges) {
+      auto page_lo = range.lo >> Memory::kPageShift;
+      auto page_hi = range.hi >> Memory::kPageShift;
+
+      for (auto page = page_lo; page <= page_hi; page++) {
+        auto line_lo = page == page_lo ? (range.lo & Memory::kPageMask) >> Memory::kCodeLineShift : 0U;
+        auto line_hi = page == page_hi ? (range.hi & Memory::kPageMask) >> Memory::kCodeLineShift : 31U;
+        auto line_mask = u32((2ULL << line_hi) - (1ULL << line_lo));
+
+        functor(page, line_mask);
+      }
+    }
+  }
+
+  void AddToPageIndex(BasicBlock* block) {
+    ForEachPage(block, [&](u32 page, u32 line_mask) {
+      auto& basic_blocks = pages[page];
+
+      if (basic_blocks.empty() || basic_blocks.back() != block) {
+        basic_blocks.push_back(block);
+      }
+
+      (*line_masks)[page] |= line_mask;
+
+      ForEachAlias(page, [&](u32 alias) {
+        (*code_pages)[alias] |= line_mask;
+      });
+    });
+  }
+
+  void RemoveFromPageIndex(BasicBlock* block) {
+    ForEachPage(block, [&](u32 page, u32) {
+      auto match = pages.find(page);
+
+      if (match != pages.end()) {
+        auto& basic_blocks = match->second;
+
+        basic_blocks.erase(
+          std::remove(basic_blocks.begin(), basic_blocks.end(), block),
+          basic_blocks.end()
+        );
+
+        // Other basic blocks may still overlap the lines, so rebuild the mask from them.
+        auto new_line_mask = 0U;
+
+        for (auto other_block : basic_blocks) {
+          ForEachPage(other_block, [&](u32 other_page, u32 other_line_mask) {
+            if (other_page == page) {
+              new_line_mask |= other_line_mask;
+            }
+          });
+        }
+
+        (*line_masks)[page] = new_line_mask;
+        UpdateCodePage(page);
+
+        if (basic_blocks.empty()) {
+          pages.erase(match);
+        }
+      }
+    });
+  }
+
+  void Allocate(size_t capacity) {
+    entries = new Entry[capacity];
+    mask = capacity - 1;
+    size = 0;
+    basic_blocks = std::make_unique<std::unique_ptr<BasicBlock>[]>(capacity);
+  }
+
+  /**
+   * Find the slot which holds a key or the empty slot where it would be inserted.
+   *
+   * @param  key  the block key to search for
+   * @returns the slot index
+   */
+  auto Find(u64 key) const -> size_t {
+    auto slot = Hash(key) & mask;
+
+    while (entries[slot].key != key && entries[slot].key != 0) {
+      slot = (slot + 1) & mask;
+    }
+
+    return slot;
+  }
+
+  // Remove an entry and move back the entries following it to close the gap.
+  void Remove(size_t slot) {
+    auto hole = slot;
+
+    while (true) {
+      slot = (slot + 1) & mask;
+
+      auto key = entries[slot].key;
+
+      if (key == 0) {
+        break;
+      }
+
+      // Entries which are already at or before their ideal slot must not be moved past it.
+      auto home = Hash(key) & mask;
+      if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+        entries[hole] = entries[slot];
+        basic_blocks[hole] = std::move(basic_blocks[slot]);
+        hole = slot;
+      }
+    }
+
+    entries[hole] = {};
+    basic_blocks[hole] = nullptr;
+    size--;
+  }
+
+  void Grow() {
+    auto old_capacity = size_t(mask + 1);
+    auto old_entries = entries;
+    auto old_basic_blocks = std::move(basic_blocks);
+
+    Allocate(old_capacity * 2);
+
+    for (size_t slot = 0; slot < old_capacity; slot++) {
+      if (old_entries[slot].key != 0) {
+        auto new_slot = Find(old_entries[slot].key);
+
+        entries[new_slot] = old_entries[slot];
+        basic_blocks[new_slot] = std::move(old_basic_blocks[slot]);
+        size++;
+      }
+    }
+
+    delete[] old_entries;
+  }
 };
 
 } // namespace lunatic::frontend
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMBlockDataTransfer const& opcode) -> Status {
+  auto list = opcode.reg_list;
+  auto transfer_pc = bit::get_bit(list, 15);
+  bool base_is_first = false;
+  bool base_is_last  = false;
+
+  u32 bytes = 0;
+
+  if (list == 0) {
+    bytes = 16 * sizeof(u32);
+    if (!armv5te) {
+      list = 1 << 15;
+      transfer_pc = true;
+    }
+  } else {
+    base_is_first = (list & ((1 << int(opcode.reg_base)) - 1)) == 0;
+    base_is_last  = (list >> int(opcode.reg_base)) == 1;
+
+    // Calculate the number of bytes to transfer.
+    for (int i = 0; i <= 15; i++) {
+      if (bit::get_bit(list, i))
+        bytes += sizeof(u32);
+    }
+  }
+
+  u32 base_lo;
+  u32 base_hi;
+
+  // Calculate the low and high addresses.
+  if (opcode.add) {
+    base_lo = GetGPR(opcode.reg_base);
+    base_hi = base_lo + bytes;
+  } else {
+    base_hi = GetGPR(opcode.reg_base);
+    base_lo = base_hi - bytes;
+  }
+
+  auto writeback = [&]() {
+    GetGPR(opcode.reg_base) = opcode.add ? base_hi : base_lo;
+  };
+
+  if (!opcode.load || !transfer_pc) {
+    AdvancePC();
+  }
+
+  auto forced_mode = opcode.user_mode ? Mode::User : mode;
+  auto address = base_lo;
+
+  bool early_writeback = opcode.writeback && !opcode.load && !armv5te && !base_is_first;
+
+  // STM ARMv4: store new base unless it is the first register
+  // STM ARMv5: always store old base.
+  if (early_writeback) {
+    writeback();
+  }
+
+  // Load or store a set of registers from/to memory.
+  for (int i = 0; i <= 15; i++)  {
+    if (!bit::get_bit(list, i))
+      continue;
+
+    auto reg = static_cast<GPR>(i);
+
+    if (opcode.pre_increment == opcode.add) {
+      address += sizeof(u32);
+    }
+
+    if (opcode.load) {
+      GetGPR(reg, forced_mode) = ReadWord(address);
+    } else {
+      WriteWord(address, GetGPR(reg, forced_mode));
+    }
+
+    if (opcode.pre_increment != opcode.add) {
+      address += sizeof(u32);
+    }
+  }
+
+  if (opcode.user_mode && opcode.load && transfer_pc) {
+    LoadSPSRToCPSR();
+  }
+
+  if (opcode.writeback) {
+    if (opcode.load) {
+      if (armv5te) {
+        // LDM ARMv5: writeback if base is the only register or not the last register.
+        if (!base_is_last || list == (1 << int(opcode.reg_base)))
+          writeback();
+      } else {
+        // LDM ARMv4: writeback if base in not in the register list.
+        if (!bit::get_bit(list, int(opcode.reg_base)))
+          writeback();
+      }
+    } else if (!early_writeback) {
+      writeback();
+    }
+  }
+
+  // Flush the pipeline if we loaded R15.
+  if (opcode.load && transfer_pc) {
+    if (opcode.user_mode) {
+      Flush();
+    } else if (armv5te) {
+      // Branch with exchange
+      FlushExchange(GetGPR(GPR::PC));
+    } else {
+      FlushNoSwitch();
+    }
+
+    return Status::BreakBasicBlock;
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMBranchExchange const& opcode) -> Status {
+  auto address = GetGPR(opcode.reg);
+
+  if (armv5te && opcode.link) {
+    auto link_address = code_address + opcode_size;
+    if (thumb_mode) {
+      link_address |= 1;
+    }
+    GetGPR(GPR::LR) = link_address;
+  }
+
+  FlushExchange(address);
+
+  return Status::BreakBasicBlock;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMBranchRelative const& opcode) -> Status {
+  auto branch_address = code_address + opcode_size * 2 + opcode.offset;
+
+  if (opcode.link) {
+    // Note: thumb BL consists of two 16-bit opcodes.
+    u32 link_address = code_address + sizeof(u32);
+    if (thumb_mode) {
+      link_address |= 1;
+    }
+    GetGPR(GPR::LR) = link_address;
+  }
+
+  if (opcode.exchange) {
+    auto& cpsr = GetCPSR();
+
+    if (thumb_mode) {
+      branch_address &= ~3;
+      branch_address += sizeof(u32) * 2;
+      cpsr.f.thumb = 0;
+    } else {
+      branch_address += sizeof(u16) * 2;
+      cpsr.f.thumb = 1;
+    }
+  } else {
+    branch_address += opcode_size * 2;
+  }
+
+  GetGPR(GPR::PC) = branch_address;
+
+  return Status::BreakBasicBlock;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
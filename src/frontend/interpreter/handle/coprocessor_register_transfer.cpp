@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMCoprocessorRegisterTransfer const& opcode) -> Status {
+  auto coprocessor = coprocessors[opcode.coprocessor_id];
+
+  // TODO: throw an undefined opcode exception.
+  if (coprocessor == nullptr) {
+    return Status::Unimplemented;
+  }
+
+  if (opcode.load) {
+    GetGPR(opcode.reg_dst) = coprocessor->Read(opcode.opcode1, opcode.cn, opcode.cm, opcode.opcode2);
+  } else {
+    coprocessor->Write(opcode.opcode1, opcode.cn, opcode.cm, opcode.opcode2, GetGPR(opcode.reg_dst));
+  }
+
+  AdvancePC();
+
+  if (!opcode.load && coprocessor->ShouldWriteBreakBasicBlock(opcode.opcode1, opcode.cn, opcode.cm, opcode.opcode2)) {
+    return Status::BreakBasicBlock;
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
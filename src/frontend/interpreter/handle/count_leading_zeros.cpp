@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMCountLeadingZeros const& opcode) -> Status {
+  auto operand = GetGPR(opcode.reg_src);
+
+  GetGPR(opcode.reg_dst) = bit::count_leading_zeros(operand);
+
+  AdvancePC();
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
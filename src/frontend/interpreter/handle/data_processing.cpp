@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMDataProcessing const& opcode) -> Status {
+  using Opcode = ARMDataProcessing::Opcode;
+
+  auto& cpsr = GetCPSR();
+  bool carry = cpsr.f.c;
+  bool advance_pc_early = false;
+  u32 op2;
+
+  if (opcode.immediate) {
+    auto value = opcode.op2_imm.value;
+    auto shift = opcode.op2_imm.shift;
+
+    op2 = bit::rotate_right<u32>(value, shift);
+
+    if (shift != 0) {
+      carry = bit::get_bit<u32, bool>(value, shift - 1);
+    }
+  } else {
+    auto& shift = opcode.op2_reg.shift;
+    u32 amount;
+
+    if (shift.immediate) {
+      amount = shift.amount_imm;
+    } else {
+      amount = GetGPR(shift.amount_reg) & 0xFF;
+
+      // PC reads as the address of the instruction plus twelve from here on.
+      AdvancePC();
+      advance_pc_early = true;
+    }
+
+    op2 = ApplyShift(shift.type, GetGPR(opcode.op2_reg.reg), amount, shift.immediate, carry);
+  }
+
+  auto op1 = [&]() -> u32 {
+    if (opcode.reg_op1 == GPR::PC && opcode.thumb_load_address) {
+      return (code_address & ~3) + opcode_size * 2;
+    }
+    return GetGPR(opcode.reg_op1);
+  };
+
+  auto logical = [&](u32 result) {
+    if (opcode.set_flags) {
+      SetNZ(result);
+      cpsr.f.c = carry;
+    }
+    return result;
+  };
+
+  switch (opcode.opcode) {
+    case Opcode::AND: GetGPR(opcode.reg_dst) = logical(op1() & op2); break;
+    case Opcode::EOR: GetGPR(opcode.reg_dst) = logical(op1() ^ op2); break;
+    case Opcode::SUB: GetGPR(opcode.reg_dst) = SUB(op1(), op2, opcode.set_flags); break;
+    case Opcode::RSB: GetGPR(opcode.reg_dst) = SUB(op2, op1(), opcode.set_flags); break;
+    case Opcode::ADD: GetGPR(opcode.reg_dst) = ADD(op1(), op2, opcode.set_flags); break;
+    case Opcode::ADC: GetGPR(opcode.reg_dst) = ADC(op1(), op2, cpsr.f.c, opcode.set_flags); break;
+    case Opcode::SBC: GetGPR(opcode.reg_dst) = SBC(op1(), op2, cpsr.f.c, opcode.set_flags); break;
+    case Opcode::RSC: GetGPR(opcode.reg_dst) = SBC(op2, op1(), cpsr.f.c, opcode.set_flags); break;
+    case Opcode::TST: logical(op1() & op2); break;
+    case Opcode::TEQ: logical(op1() ^ op2); break;
+    case Opcode::CMP: SUB(op1(), op2, true); break;
+    case Opcode::CMN: ADD(op1(), op2, true); break;
+    case Opcode::ORR: GetGPR(opcode.reg_dst) = logical(op1() | op2); break;
+    case Opcode::MOV: GetGPR(opcode.reg_dst) = logical(op2); break;
+    case Opcode::BIC: GetGPR(opcode.reg_dst) = logical(op1() & ~op2); break;
+    case Opcode::MVN: GetGPR(opcode.reg_dst) = logical(~op2); break;
+  }
+
+  if (opcode.reg_dst == GPR::PC && opcode.set_flags) {
+    LoadSPSRToCPSR();
+  }
+
+  if (opcode.reg_dst == GPR::PC &&
+      opcode.opcode != Opcode::CMP &&
+      opcode.opcode != Opcode::CMN &&
+      opcode.opcode != Opcode::TST &&
+      opcode.opcode != Opcode::TEQ) {
+    if (opcode.set_flags) {
+      Flush();
+    } else {
+      FlushNoSwitch();
+    }
+    return Status::BreakBasicBlock;
+  } else if (!advance_pc_early) {
+    AdvancePC();
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
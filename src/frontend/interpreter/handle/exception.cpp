@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMException const& opcode) -> Status {
+  Mode new_mode;
+  auto exception = opcode.exception;
+
+  switch (exception) {
+    case Exception::Supervisor:
+      new_mode = Mode::Supervisor;
+      break;
+    default:
+      throw std::runtime_error(fmt::format("unhandled exception vector: 0x{:X}", static_cast<int>(exception)));
+  }
+
+  auto& cpsr = GetCPSR();
+
+  // Save current PSR in the saved PSR.
+  GetSPSR(new_mode) = cpsr;
+
+  // Enter supervisor mode and disable IRQs.
+  cpsr.v = (cpsr.v & ~0x3FU) | static_cast<u32>(new_mode) | 0x80;
+
+  // Save next PC in LR
+  GetGPR(GPR::LR, new_mode) = code_address + opcode_size;
+
+  // Set PC to the exception vector.
+  GetGPR(GPR::PC, new_mode) = exception_base + static_cast<u32>(exception) + sizeof(u32) * 2;
+
+  return Status::BreakBasicBlock;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
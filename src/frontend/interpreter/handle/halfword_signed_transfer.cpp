@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMHalfwordSignedTransfer const& opcode) -> Status {
+  bool should_writeback = !opcode.pre_increment || opcode.writeback;
+  bool should_flush_pipeline = opcode.load && opcode.reg_dst == GPR::PC;
+
+  auto offset = opcode.immediate ? opcode.offset_imm : GetGPR(opcode.offset_reg);
+  auto base_old = GetGPR(opcode.reg_base);
+  auto base_new = opcode.add ? (base_old + offset) : (base_old - offset);
+  auto address = opcode.pre_increment ? base_new : base_old;
+
+  auto writeback = [&]() {
+    if (should_writeback) {
+      GetGPR(opcode.reg_base) = base_new;
+    }
+  };
+
+  AdvancePC();
+
+  switch (opcode.opcode) {
+    case 1: {
+      if (opcode.load) {
+        writeback();
+        if (armv5te) {
+          GetGPR(opcode.reg_dst) = ReadHalf(address);
+        } else {
+          GetGPR(opcode.reg_dst) = bit::rotate_right<u32>(ReadHalf(address), (address & 1) * 8);
+        }
+      } else {
+        WriteHalf(address, GetGPR(opcode.reg_dst));
+        writeback();
+      }
+      break;
+    }
+    case 2: {
+      if (opcode.load) {
+        writeback();
+        GetGPR(opcode.reg_dst) = u32(s8(ReadByte(address)));
+      } else if (armv5te) {
+        auto reg_dst_a = opcode.reg_dst;
+        auto reg_dst_b = static_cast<GPR>(static_cast<int>(reg_dst_a) + 1);
+
+        // LDRD with odd-numbered destination register is undefined.
+        if ((static_cast<int>(reg_dst_a) & 1) == 1) {
+          return Status::Unimplemented;
+        }
+
+        auto data_a = ReadWord(address);
+        auto data_b = ReadWord(address + sizeof(u32));
+
+        GetGPR(reg_dst_a) = data_a;
+        writeback();
+        GetGPR(reg_dst_b) = data_b;
+
+        if (reg_dst_b == GPR::PC) {
+          should_flush_pipeline = true;
+        }
+      } else {
+        writeback();
+      }
+      break;
+    }
+    case 3: {
+      if (opcode.load) {
+        writeback();
+        if (!armv5te && (address & 1)) {
+          // ARM7TDMI/ARMv4T special case: unaligned LDRSH is effectively LDRSB.
+          GetGPR(opcode.reg_dst) = u32(s8(ReadHalf(address) >> 8));
+        } else {
+          GetGPR(opcode.reg_dst) = u32(s16(ReadHalf(address)));
+        }
+      } else {
+        if (armv5te) {
+          auto reg_dst_a = opcode.reg_dst;
+          auto reg_dst_b = static_cast<GPR>(static_cast<int>(reg_dst_a) + 1);
+
+          // STRD with odd-numbered destination register is undefined.
+          if ((static_cast<int>(reg_dst_a) & 1) == 1) {
+            return Status::Unimplemented;
+          }
+
+          auto data_a = GetGPR(reg_dst_a);
+          auto data_b = GetGPR(reg_dst_b);
+
+          WriteWord(address, data_a);
+          WriteWord(address + sizeof(u32), data_b);
+        }
+
+        writeback();
+      }
+      break;
+    }
+    default: {
+      // Unreachable?
+      return Status::Unimplemented;
+    }
+  }
+
+  if (should_flush_pipeline) {
+    if (armv5te) {
+      FlushExchange(GetGPR(GPR::PC));
+    } else {
+      FlushNoSwitch();
+    }
+    return Status::BreakBasicBlock;
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
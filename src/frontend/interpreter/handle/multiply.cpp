@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMMultiply const& opcode) -> Status {
+  auto result = GetGPR(opcode.reg_op1) * GetGPR(opcode.reg_op2);
+
+  if (opcode.accumulate) {
+    result += GetGPR(opcode.reg_op3);
+  }
+
+  GetGPR(opcode.reg_dst) = result;
+
+  AdvancePC();
+
+  if (opcode.set_flags) {
+    SetNZ(result);
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
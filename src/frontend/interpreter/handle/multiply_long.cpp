@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMMultiplyLong const& opcode) -> Status {
+  auto lhs = GetGPR(opcode.reg_op1);
+  auto rhs = GetGPR(opcode.reg_op2);
+  u64 result;
+
+  if (opcode.sign_extend) {
+    result = u64(s64(s32(lhs)) * s64(s32(rhs)));
+  } else {
+    result = u64(lhs) * u64(rhs);
+  }
+
+  if (opcode.accumulate) {
+    result += (u64(GetGPR(opcode.reg_dst_hi)) << 32) | GetGPR(opcode.reg_dst_lo);
+  }
+
+  GetGPR(opcode.reg_dst_hi) = u32(result >> 32);
+  GetGPR(opcode.reg_dst_lo) = u32(result);
+
+  AdvancePC();
+
+  if (opcode.set_flags) {
+    auto& flags = GetCPSR().f;
+
+    flags.n = result >> 63;
+    flags.z = result == 0;
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
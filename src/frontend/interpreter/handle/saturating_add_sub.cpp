@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMSaturatingAddSub const& opcode) -> Status {
+  auto lhs = GetGPR(opcode.reg_lhs);
+  auto rhs = GetGPR(opcode.reg_rhs);
+
+  if (opcode.double_rhs) {
+    rhs = QADD(rhs, rhs);
+  }
+
+  if (opcode.subtract) {
+    GetGPR(opcode.reg_dst) = QSUB(lhs, rhs);
+  } else {
+    GetGPR(opcode.reg_dst) = QADD(lhs, rhs);
+  }
+
+  AdvancePC();
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+static auto GetHalf(u32 value, bool top) -> s32 {
+  if (top) {
+    return s32(value) >> 16;
+  }
+  return s32(value << 16) >> 16;
+}
+
+auto Interpreter::Handle(ARMSignedHalfwordMultiply const& opcode) -> Status {
+  auto lhs = GetHalf(GetGPR(opcode.reg_lhs), opcode.x);
+  auto rhs = GetHalf(GetGPR(opcode.reg_rhs), opcode.y);
+  auto result = u32(lhs * rhs);
+
+  if (opcode.accumulate) {
+    auto op3 = GetGPR(opcode.reg_op3);
+    auto result_acc = result + op3;
+
+    // Set the sticky overflow flag if the signed accumulation overflowed.
+    if (((result ^ result_acc) & (op3 ^ result_acc)) >> 31) {
+      GetCPSR().f.q = 1;
+    }
+    GetGPR(opcode.reg_dst) = result_acc;
+
+    AdvancePC();
+    return Status::BreakBasicBlock;
+  }
+
+  GetGPR(opcode.reg_dst) = result;
+  AdvancePC();
+  return Status::Continue;
+}
+
+auto Interpreter::Handle(ARMSignedWordHalfwordMultiply const& opcode) -> Status {
+  auto lhs = s64(s32(GetGPR(opcode.reg_lhs)));
+  auto rhs = GetHalf(GetGPR(opcode.reg_rhs), opcode.y);
+  auto result = u32((lhs * rhs) >> 16);
+
+  if (opcode.accumulate) {
+    auto op3 = GetGPR(opcode.reg_op3);
+    auto result_acc = result + op3;
+
+    // Set the sticky overflow flag if the signed accumulation overflowed.
+    if (((result ^ result_acc) & (op3 ^ result_acc)) >> 31) {
+      GetCPSR().f.q = 1;
+    }
+    GetGPR(opcode.reg_dst) = result_acc;
+
+    AdvancePC();
+    return Status::BreakBasicBlock;
+  }
+
+  GetGPR(opcode.reg_dst) = result;
+  AdvancePC();
+  return Status::Continue;
+}
+
+auto Interpreter::Handle(ARMSignedHalfwordMultiplyAccumulateLong const& opcode) -> Status {
+  auto lhs = GetHalf(GetGPR(opcode.reg_lhs), opcode.x);
+  auto rhs = GetHalf(GetGPR(opcode.reg_rhs), opcode.y);
+  auto dst = (u64(GetGPR(opcode.reg_dst_hi)) << 32) | GetGPR(opcode.reg_dst_lo);
+  auto result = dst + u64(s64(lhs * rhs));
+
+  GetGPR(opcode.reg_dst_hi) = u32(result >> 32);
+  GetGPR(opcode.reg_dst_lo) = u32(result);
+
+  AdvancePC();
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMSingleDataSwap const& opcode) -> Status {
+  if (opcode.reg_dst == GPR::PC) {
+    return Status::Unimplemented;
+  }
+
+  auto address = GetGPR(opcode.reg_base);
+  auto source = GetGPR(opcode.reg_src);
+  u32 tmp;
+
+  if (opcode.byte) {
+    tmp = ReadByte(address);
+    WriteByte(address, source);
+  } else {
+    tmp = ReadWordRotate(address);
+    WriteWord(address, source);
+  }
+
+  GetGPR(opcode.reg_dst) = tmp;
+  AdvancePC();
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
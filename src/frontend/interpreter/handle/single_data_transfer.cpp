@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMSingleDataTransfer const& opcode) -> Status {
+  if (!opcode.pre_increment && opcode.writeback) {
+    // LDRT and STRT are not supported right now.
+    return Status::Unimplemented;
+  }
+
+  u32 offset;
+
+  if (opcode.immediate) {
+    offset = opcode.offset_imm;
+  } else {
+    bool carry = GetCPSR().f.c;
+
+    offset = ApplyShift(opcode.offset_reg.shift, GetGPR(opcode.offset_reg.reg), opcode.offset_reg.amount, true, carry);
+  }
+
+  u32 base_old;
+
+  if (opcode.reg_base == GPR::PC) {
+    // PC-relative loads in Thumb-mode use the word-aligned PC.
+    base_old = (code_address & ~3) + opcode_size * 2;
+  } else {
+    base_old = GetGPR(opcode.reg_base);
+  }
+
+  auto base_new = opcode.add ? (base_old + offset) : (base_old - offset);
+  auto address = opcode.pre_increment ? base_new : base_old;
+
+  AdvancePC();
+
+  auto writeback = [&]() {
+    if (!opcode.pre_increment || opcode.writeback) {
+      GetGPR(opcode.reg_base) = base_new;
+    }
+  };
+
+  if (opcode.load) {
+    writeback();
+
+    if (opcode.byte) {
+      GetGPR(opcode.reg_dst) = ReadByte(address);
+    } else {
+      GetGPR(opcode.reg_dst) = ReadWordRotate(address);
+    }
+  } else {
+    auto data = GetGPR(opcode.reg_dst);
+
+    if (opcode.byte) {
+      WriteByte(address, data);
+    } else {
+      WriteWord(address, data);
+    }
+
+    writeback();
+  }
+
+  if (opcode.load && opcode.reg_dst == GPR::PC) {
+    if (armv5te) {
+      // Branch with exchange
+      FlushExchange(GetGPR(GPR::PC));
+    } else {
+      FlushNoSwitch();
+    }
+    return Status::BreakBasicBlock;
+  }
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
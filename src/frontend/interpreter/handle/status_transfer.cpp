@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ARMMoveStatusRegister const& opcode) -> Status {
+  u32 mask = 0;
+
+  if (opcode.fsxc & 1) mask |= 0x000000FF;
+  if (opcode.fsxc & 2) mask |= 0x0000FF00;
+  if (opcode.fsxc & 4) mask |= 0x00FF0000;
+  if (opcode.fsxc & 8) mask |= 0xFF000000;
+
+  auto& psr = opcode.spsr ? GetSPSR(mode) : GetCPSR();
+  auto value = opcode.immediate ? opcode.imm : GetGPR(opcode.reg);
+
+  AdvancePC();
+
+  psr.v = (psr.v & ~mask) | (value & mask);
+
+  return opcode.spsr ? Status::Continue : Status::BreakBasicBlock;
+}
+
+auto Interpreter::Handle(ARMMoveRegisterStatus const& opcode) -> Status {
+  if (opcode.spsr) {
+    GetGPR(opcode.reg) = GetSPSR(mode).v;
+  } else {
+    GetGPR(opcode.reg) = GetCPSR().v;
+  }
+
+  AdvancePC();
+
+  return Status::Continue;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "frontend/interpreter/interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+auto Interpreter::Handle(ThumbBranchLinkSuffix const& opcode) -> Status {
+  auto address = GetGPR(GPR::LR) + opcode.offset;
+
+  GetGPR(GPR::LR) = (code_address + sizeof(u16)) | 1;
+
+  if (armv5te && opcode.exchange) {
+    GetCPSR().f.thumb = 0;
+    GetGPR(GPR::PC) = (address & ~3) + sizeof(u32) * 2;
+  } else {
+    GetGPR(GPR::PC) = (address & ~1) + sizeof(u16) * 2;
+  }
+
+  return Status::BreakBasicBlock;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
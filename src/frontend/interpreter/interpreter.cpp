@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <fmt/format.h>
+#include <stdexcept>
+
+#include "interpreter.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+Interpreter::Interpreter(CPU::Descriptor const& descriptor, State& state)
+    : armv5te(descriptor.model == CPU::Descriptor::Model::ARM9)
+    , max_block_size(descriptor.block_size)
+    , exception_base(descriptor.exception_base)
+    , memory(descriptor.memory)
+    , coprocessors(descriptor.coprocessors)
+    , state(state)
+    , decode_cache(kDecodeCacheSize) {
+}
+
+auto Interpreter::Run(int cycles) -> int {
+  auto& cycle_counter = state.GetCycleCounter();
+
+  cycle_counter = cycles;
+
+  for (int i = 0; i < max_block_size && cycle_counter > 0; i++) {
+    // Count the instruction before running it, like compiled code does.
+    cycle_counter--;
+
+    if (Step() == Status::BreakBasicBlock) {
+      break;
+    }
+  }
+
+  return cycle_counter;
+}
+
+auto Interpreter::Step() -> Status {
+  auto cpsr = GetCPSR();
+
+  mode = cpsr.f.mode;
+  thumb_mode = cpsr.f.thumb;
+  opcode_size = thumb_mode ? sizeof(u16) : sizeof(u32);
+  code_address = GetGPR(GPR::PC) - 2 * opcode_size;
+
+  auto status = Status::Continue;
+
+  if (thumb_mode) {
+    u32 instruction;
+
+    if (code_address & 2) {
+      instruction  = memory.FastRead<u16, Memory::Bus::Code>(code_address + 0);
+      instruction |= memory.FastRead<u16, Memory::Bus::Code>(code_address + 2) << 16;
+    } else {
+      instruction = memory.FastRead<u32, Memory::Bus::Code>(code_address);
+    }
+
+    // Conditional branches are the only Thumb instructions with a condition.
+    if ((instruction & 0xF000) == 0xD000 && (instruction & 0xF00) != 0xF00 &&
+        !CheckCondition(bit::get_field<u16, Condition>(instruction, 8, 4))) {
+      AdvancePC();
+      return Status::Continue;
+    }
+
+    status = Execute(instruction);
+
+    if (status == Status::Unimplemented) {
+      throw std::runtime_error(
+        fmt::format("lunatic: unknown opcode 0x{:04X} @ 0x{:08X} (thumb={})",
+          instruction, code_address, 1)
+      );
+    }
+  } else {
+    auto instruction = memory.FastRead<u32, Memory::Bus::Code>(code_address);
+    auto condition = bit::get_field<u32, Condition>(instruction, 28, 4);
+
+    // ARMv5TE+ treats condition code 'NV' as a separate
+    // encoding space for unpredicated instructions.
+    if (armv5te && condition == Condition::NV) {
+      condition = Condition::AL;
+    }
+
+    if (!CheckCondition(condition)) {
+      AdvancePC();
+      return Status::Continue;
+    }
+
+    status = Execute(instruction);
+
+    if (status == Status::Unimplemented) {
+      throw std::runtime_error(
+        fmt::format("lunatic: unknown opcode 0x{:08X} @ 0x{:08X} (thumb={})",
+          instruction, code_address, 0)
+      );
+    }
+  }
+
+  return status;
+}
+
+auto Interpreter::Execute(u32 instruction) -> Status {
+  auto& entry = decode_cache[(code_address >> 1) & (kDecodeCacheSize - 1)];
+
+  // The cached opcode is compared to guest memory, so that modified code is decoded again.
+  if (entry.handler == nullptr ||
+      entry.address != code_address ||
+      entry.instruction != instruction ||
+      entry.thumb != thumb_mode) {
+    auto decoder = Decoder{entry};
+
+    if (thumb_mode) {
+      decode_thumb(instruction, decoder);
+    } else {
+      decode_arm(instruction, decoder);
+    }
+
+    entry.address = code_address;
+    entry.instruction = instruction;
+    entry.thumb = thumb_mode;
+  }
+
+  return entry.handler(*this, entry.opcode);
+}
+
+bool Interpreter::CheckCondition(Condition condition) {
+  auto& flags = GetCPSR().f;
+
+  switch (condition) {
+    case Condition::EQ: return  flags.z;
+    case Condition::NE: return !flags.z;
+    case Condition::CS: return  flags.c;
+    case Condition::CC: return !flags.c;
+    case Condition::MI: return  flags.n;
+    case Condition::PL: return !flags.n;
+    case Condition::VS: return  flags.v;
+    case Condition::VC: return !flags.v;
+    case Condition::HI: return  flags.c && !flags.z;
+    case Condition::LS: return !flags.c ||  flags.z;
+    case Condition::GE: return flags.n == flags.v;
+    case Condition::LT: return flags.n != flags.v;
+    case Condition::GT: return !flags.z && flags.n == flags.v;
+    case Condition::LE: return  flags.z || flags.n != flags.v;
+    case Condition::AL: return true;
+    case Condition::NV: return false;
+  }
+
+  return false;
+}
+
+auto Interpreter::Undefined(u32 opcode) -> Status {
+  return Status::Unimplemented;
+}
+
+auto Interpreter::ApplyShift(Shift type, u32 value, u32 amount, bool immediate, bool& carry) -> u32 {
+  switch (type) {
+    case Shift::LSL: {
+      if (amount == 0) {
+        return value;
+      }
+      if (amount >= 32) {
+        carry = amount == 32 && (value & 1);
+        return 0;
+      }
+      carry = bit::get_bit<u32, bool>(value, 32 - amount);
+      return value << amount;
+    }
+    case Shift::LSR: {
+      // LSR #0 equals to LSR #32
+      if (immediate && amount == 0) {
+        amount = 32;
+      }
+      if (amount == 0) {
+        return value;
+      }
+      if (amount >= 32) {
+        carry = amount == 32 && (value >> 31);
+        return 0;
+      }
+      carry = bit::get_bit<u32, bool>(value, amount - 1);
+      return value >> amount;
+    }
+    case Shift::ASR: {
+      // ASR #0 equals to ASR #32
+      if (immediate && amount == 0) {
+        amount = 32;
+      }
+      if (amount == 0) {
+        return value;
+      }
+      if (amount >= 32) {
+        carry = value >> 31;
+        return carry ? 0xFFFFFFFF : 0;
+      }
+      carry = bit::get_bit<u32, bool>(value, amount - 1);
+      return u32(s32(value) >> amount);
+    }
+    case Shift::ROR: {
+      // ROR #0 equals to RRX #1
+      if (immediate && amount == 0) {
+        auto carry_in = carry;
+        carry = value & 1;
+        return (value >> 1) | (u32(carry_in) << 31);
+      }
+      if (amount == 0) {
+        return value;
+      }
+      value = bit::rotate_right<u32>(value, amount & 31);
+      carry = value >> 31;
+      return value;
+    }
+  }
+
+  return value;
+}
+
+auto Interpreter::ADC(u32 lhs, u32 rhs, bool carry, bool set_flags) -> u32 {
+  u64 result = u64(lhs) + u64(rhs) + u64(carry);
+
+  if (set_flags) {
+    auto& flags = GetCPSR().f;
+
+    SetNZ(u32(result));
+    flags.c = result >> 32;
+    flags.v = ((lhs ^ u32(result)) & (rhs ^ u32(result))) >> 31;
+  }
+
+  return u32(result);
+}
+
+auto Interpreter::QADD(u32 lhs, u32 rhs) -> u32 {
+  s64 result = s64(s32(lhs)) + s64(s32(rhs));
+
+  if (result > INT32_MAX) {
+    GetCPSR().f.q = 1;
+    return 0x7FFF'FFFF;
+  }
+
+  if (result < INT32_MIN) {
+    GetCPSR().f.q = 1;
+    return 0x8000'0000;
+  }
+
+  return u32(result);
+}
+
+auto Interpreter::QSUB(u32 lhs, u32 rhs) -> u32 {
+  s64 result = s64(s32(lhs)) - s64(s32(rhs));
+
+  if (result > INT32_MAX) {
+    GetCPSR().f.q = 1;
+    return 0x7FFF'FFFF;
+  }
+
+  if (result < INT32_MIN) {
+    GetCPSR().f.q = 1;
+    return 0x8000'0000;
+  }
+
+  return u32(result);
+}
+
+void Interpreter::SetNZ(u32 value) {
+  auto& flags = GetCPSR().f;
+
+  flags.n = value >> 31;
+  flags.z = value == 0;
+}
+
+auto Interpreter::ReadByte(u32 address) -> u32 {
+  return memory.FastRead<u8, Memory::Bus::Data>(address);
+}
+
+auto Interpreter::ReadHalf(u32 address) -> u32 {
+  return memory.FastRead<u16, Memory::Bus::Data>(address);
+}
+
+auto Interpreter::ReadWord(u32 address) -> u32 {
+  return memory.FastRead<u32, Memory::Bus::Data>(address);
+}
+
+auto Interpreter::ReadWordRotate(u32 address) -> u32 {
+  return bit::rotate_right<u32>(ReadWord(address), (address & 3) * 8);
+}
+
+void Interpreter::WriteByte(u32 address, u32 value) {
+  memory.FastWrite<u8, Memory::Bus::Data>(address, u8(value));
+}
+
+void Interpreter::WriteHalf(u32 address, u32 value) {
+  memory.FastWrite<u16, Memory::Bus::Data>(address, u16(value));
+}
+
+void Interpreter::WriteWord(u32 address, u32 value) {
+  memory.FastWrite<u32, Memory::Bus::Data>(address, value);
+}
+
+void Interpreter::AdvancePC() {
+  GetGPR(GPR::PC) = code_address + opcode_size * 3;
+}
+
+void Interpreter::Flush() {
+  GetGPR(GPR::PC) += GetCPSR().f.thumb ? sizeof(u16) * 2 : sizeof(u32) * 2;
+}
+
+void Interpreter::FlushExchange(u32 address) {
+  auto& cpsr = GetCPSR();
+
+  if (address & 1) {
+    cpsr.f.thumb = 1;
+    GetGPR(GPR::PC) = (address & ~1) + sizeof(u16) * 2;
+  } else {
+    cpsr.f.thumb = 0;
+    GetGPR(GPR::PC) = (address & ~3) + sizeof(u32) * 2;
+  }
+}
+
+void Interpreter::FlushNoSwitch() {
+  GetGPR(GPR::PC) += opcode_size * 2;
+}
+
+void Interpreter::LoadSPSRToCPSR() {
+  GetCPSR() = GetSPSR(mode);
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <lunatic/cpu.hpp>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "frontend/decode/arm.hpp"
+#include "frontend/decode/thumb.hpp"
+#include "frontend/translator/translator.hpp"
+#include "frontend/state.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+/**
+ * Executes guest code one instruction at a time, without translating it to IR first.
+ * The semantics (including the value of PC observed by each instruction)
+ * follow the code that the translator generates for the same instruction.
+ *
+ * Decoded instructions are cached, so that each instruction only needs
+ * to be fetched and compared to the cached opcode before it is executed.
+ */
+struct Interpreter final : ARMDecodeClient<Status> {
+  Interpreter(CPU::Descriptor const& descriptor, State& state);
+
+  /**
+   * Execute instructions until a branch is taken, the maximum basic block size is reached
+   * or the cycle counter in the state runs out. Each instruction takes one cycle.
+   *
+   * @param  cycles  the number of cycles to run at most
+   * @returns the number of cycles left
+   */
+  auto Run(int cycles) -> int;
+
+  auto Handle(ARMDataProcessing const& opcode) -> Status override;
+  auto Handle(ARMMoveStatusRegister const& opcode) -> Status override;
+  auto Handle(ARMMoveRegisterStatus const& opcode) -> Status override;
+  auto Handle(ARMMultiply const& opcode) -> Status override;
+  auto Handle(ARMMultiplyLong const& opcode) -> Status override;
+  auto Handle(ARMSingleDataSwap const& opcode) -> Status override;
+  auto Handle(ARMBranchExchange const& opcode) -> Status override;
+  auto Handle(ARMHalfwordSignedTransfer const& opcode) -> Status override;
+  auto Handle(ARMSingleDataTransfer const& opcode) -> Status override;
+  auto Handle(ARMBlockDataTransfer const& opcode) -> Status override;
+  auto Handle(ARMBranchRelative const& opcode) -> Status override;
+  auto Handle(ARMCoprocessorRegisterTransfer const& opcode) -> Status override;
+  auto Handle(ARMException const& opcode) -> Status override;
+  auto Handle(ARMCountLeadingZeros const& opcode) -> Status override;
+  auto Handle(ARMSaturatingAddSub const& opcode) -> Status override;
+  auto Handle(ARMSignedHalfwordMultiply const& opcode) -> Status override;
+  auto Handle(ARMSignedWordHalfwordMultiply const& opcode) -> Status override;
+  auto Handle(ARMSignedHalfwordMultiplyAccumulateLong const& opcode) -> Status override;
+  auto Handle(ThumbBranchLinkSuffix const& opcode) -> Status override;
+  auto Undefined(u32 opcode) -> Status override;
+
+private:
+  static constexpr int kDecodeCacheSize = 4096;
+
+  // An instruction and the result of decoding it.
+  struct DecodeCacheEntry {
+    using Handler = Status (*)(Interpreter& interpreter, void const* opcode);
+
+    u32 address = 0;
+    u32 instruction = 0;
+    bool thumb = false;
+    Handler handler = nullptr;
+
+    // Storage for the decoded opcode structure, which is passed to the handler.
+    alignas(8) u8 opcode[64];
+  };
+
+  /**
+   * Decode client which stores the decoded opcode into a cache entry,
+   * together with a handler that calls the matching Handle() method directly.
+   */
+  struct Decoder {
+    using return_type = void;
+
+    template<typename T>
+    void Handle(T const& opcode) {
+      static_assert(sizeof(T) <= sizeof(DecodeCacheEntry::opcode));
+      static_assert(std::is_trivially_copyable_v<T>);
+
+      entry.handler = [](Interpreter& interpreter, void const* opcode) -> Status {
+        return interpreter.Handle(*static_cast<T const*>(opcode));
+      };
+      new (entry.opcode) T{opcode};
+    }
+
+    void Undefined(u32 opcode) {
+      entry.handler = [](Interpreter& interpreter, void const* opcode) -> Status {
+        return interpreter.Undefined(*static_cast<u32 const*>(opcode));
+      };
+      new (entry.opcode) u32{opcode};
+    }
+
+    DecodeCacheEntry& entry;
+  };
+
+  auto Step() -> Status;
+  auto Execute(u32 instruction) -> Status;
+
+  bool CheckCondition(Condition condition);
+
+  auto GetGPR(GPR reg) -> u32& { return state.GetGPR(mode, reg); }
+  auto GetGPR(GPR reg, Mode mode) -> u32& { return state.GetGPR(mode, reg); }
+  auto GetCPSR() -> StatusRegister& { return state.GetCPSR(); }
+  auto GetSPSR(Mode mode) -> StatusRegister& { return *state.GetPointerToSPSR(mode); }
+
+  /**
+   * Apply a barrel shifter operation to a value.
+   *
+   * @param  type       the type of shift
+   * @param  value      the value to shift
+   * @param  amount     the shift amount
+   * @param  immediate  whether the shift amount is encoded in the opcode,
+   *                    in which case an amount of zero has a special meaning for LSR, ASR and ROR
+   * @param  carry      the carry flag, updated with the shifter carry out
+   * @returns the shifted value
+   */
+  auto ApplyShift(Shift type, u32 value, u32 amount, bool immediate, bool& carry) -> u32;
+
+  auto ADC(u32 lhs, u32 rhs, bool carry, bool set_flags) -> u32;
+  auto ADD(u32 lhs, u32 rhs, bool set_flags) -> u32 { return ADC(lhs, rhs, false, set_flags); }
+  auto SUB(u32 lhs, u32 rhs, bool set_flags) -> u32 { return ADC(lhs, ~rhs, true, set_flags); }
+  auto SBC(u32 lhs, u32 rhs, bool carry, bool set_flags) -> u32 { return ADC(lhs, ~rhs, carry, set_flags); }
+  auto QADD(u32 lhs, u32 rhs) -> u32;
+  auto QSUB(u32 lhs, u32 rhs) -> u32;
+
+  void SetNZ(u32 value);
+
+  auto ReadByte(u32 address) -> u32;
+  auto ReadHalf(u32 address) -> u32;
+  auto ReadWord(u32 address) -> u32;
+  auto ReadWordRotate(u32 address) -> u32;
+  void WriteByte(u32 address, u32 value);
+  void WriteHalf(u32 address, u32 value);
+  void WriteWord(u32 address, u32 value);
+
+  void AdvancePC();
+  void Flush();
+  void FlushExchange(u32 address);
+  void FlushNoSwitch();
+  void LoadSPSRToCPSR();
+
+  // TODO: deduce opcode_size from thumb_mode. this is redundant.
+  u32 code_address;
+  bool thumb_mode;
+  u32 opcode_size;
+  Mode mode;
+  bool armv5te;
+  int  max_block_size;
+  u32  exception_base;
+  Memory& memory;
+  std::array<Coprocessor*, 16> coprocessors;
+  State& state;
+  std::vector<DecodeCacheEntry> decode_cache;
+};
+
+} // namespace lunatic::frontend
+} // namespace lunatic
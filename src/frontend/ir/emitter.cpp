@@ -34,12 +34,63 @@ auto IREmitter::CreateVar(
   char const* label
 ) -> IRVariable const& {
   auto id = u32(variables.size());
-  auto var = new IRVariable{id, data_type, label};
+  auto var = new (arena.Allocate(sizeof(IRVariable), alignof(IRVariable))) IRVariable{id, data_type, label};
 
-  variables.push_back(std::unique_ptr<IRVariable>(var));
+  variables.push_back(var);
+  use_lists.push_back(nullptr);
   return *var;
 }
 
+bool IREmitter::Repoint(
+  IRVariable const& var_old,
+  IRVariable const& var_new
+) {
+  if (var_old.data_type != var_new.data_type) {
+    return false;
+  }
+
+  if (&var_old == &var_new) {
+    return true;
+  }
+
+  auto use = use_lists[var_old.id];
+
+  // Move each use over to the list of the new variable.
+  while (use != nullptr) {
+    auto next = use->next;
+
+    if (!use->op->IsErased()) {
+      use->op->Repoint(var_old, var_new);
+      use->next = use_lists[var_new.id];
+      use_lists[var_new.id] = use;
+    }
+    use = next;
+  }
+
+  use_lists[var_old.id] = nullptr;
+  return true;
+}
+
+bool IREmitter::IsRead(IRVariable const& var) const {
+  for (auto use = use_lists[var.id]; use != nullptr; use = use->next) {
+    if (!use->op->IsErased() && use->op->Reads(var)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto IREmitter::CountReads(IRVariable const& var) const -> int {
+  int reads = 0;
+
+  for (auto use = use_lists[var.id]; use != nullptr; use = use->next) {
+    if (!use->op->IsErased() && use->op->Reads(var)) {
+      reads++;
+    }
+  }
+  return reads;
+}
+
 void IREmitter::LoadGPR(IRGuestReg reg, IRVariable const& result) {
   Push<IRLoadGPR>(reg, result);
 }
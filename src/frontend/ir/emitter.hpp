@@ -7,21 +7,29 @@
 
 #pragma once
 
-#include <list>
-#include <memory>
+#include <utility>
 #include <vector>
 
+#include "common/arena_allocator.hpp"
 #include "common/optional.hpp"
-#include "common/pool_allocator.hpp"
+#include "instruction_list.hpp"
 #include "opcode.hpp"
 
 namespace lunatic {
 namespace frontend {
 
+/**
+ * Builds the IR program of a micro block.
+ * Opcodes and variables are allocated from an arena owned by the emitter,
+ * so that they are laid out next to each other in memory and are released at once
+ * when the emitter is destroyed, i.e. after the backend has compiled the basic block.
+ * The arena needs no lock: with background compilation the worker thread fills it and
+ * the emulation thread destroys it, but the basic block is handed over through the result queue
+ * and is never accessed by both threads at the same time.
+ */
 struct IREmitter {
-  using OpcodePtr = std::unique_ptr<IROpcode>;
-  using InstructionList = std::list<OpcodePtr, StdPoolAlloc<OpcodePtr>>;
-  using VariableList = std::vector<std::unique_ptr<IRVariable>>;
+  using InstructionList = IRInstructionList;
+  using VariableList = std::vector<IRVariable*>;
 
   IREmitter() = default;
   IREmitter(const IREmitter&) = delete;
@@ -32,8 +40,10 @@ struct IREmitter {
   }
 
   IREmitter& operator=(IREmitter&& emitter) {
+    std::swap(arena, emitter.arena);
     std::swap(code, emitter.code);
     std::swap(variables, emitter.variables);
+    std::swap(use_lists, emitter.use_lists);
     return *this;
   }
 
@@ -42,6 +52,58 @@ struct IREmitter {
   auto Vars() const -> VariableList const& { return variables; }
   auto ToString() const -> std::string;
 
+  /**
+   * Allocate an opcode in the arena of this emitter without adding it to the code.
+   * Used by optimization passes to insert new opcodes via Code().insert().
+   */
+  template<typename T, typename... Args>
+  auto CreateOp(Args&&... args) -> T* {
+    auto op = arena.New<T>(args...);
+
+    // Any variable passed to the opcode constructor ends up in one of its operands.
+    (AddUse(args, op), ...);
+    return op;
+  }
+
+  /**
+   * Replace all uses of a variable with another variable.
+   * Takes time proportional to the number of opcodes that use the variable.
+   *
+   * @param  var_old  the variable to replace
+   * @param  var_new  the replacement
+   * @returns false if the variables have different data types and thus were not replaced
+   */
+  bool Repoint(
+    IRVariable const& var_old,
+    IRVariable const& var_new
+  );
+
+  /**
+   * Check if any opcode in the code reads a variable.
+   * Takes time proportional to the number of opcodes that use the variable.
+   */
+  bool IsRead(IRVariable const& var) const;
+
+  /**
+   * Count the opcodes in the code that read a variable.
+   * Takes time proportional to the number of opcodes that use the variable.
+   */
+  auto CountReads(IRVariable const& var) const -> int;
+
+  /**
+   * Call a function for each (non-erased) opcode that reads or writes a variable.
+   * An opcode may be visited more than once.
+   * Takes time proportional to the number of opcodes that use the variable.
+   */
+  template<typename Fn>
+  void VisitUses(IRVariable const& var, Fn&& fn) const {
+    for (auto use = use_lists[var.id]; use != nullptr; use = use->next) {
+      if (!use->op->IsErased()) {
+        fn(use->op);
+      }
+    }
+  }
+
   auto CreateVar(
     IRDataType data_type,
     char const* label = nullptr
@@ -269,11 +331,45 @@ struct IREmitter {
 private:
   template<typename T, typename... Args>
   void Push(Args&&... args) {
-    code.push_back(std::make_unique<T>(args...));
+    code.push_back(CreateOp<T>(std::forward<Args>(args)...));
   }
 
+  // Node in the list of opcodes that read or write a variable.
+  struct Use {
+    Use(IROpcode* op, Use* next) : op(op), next(next) {}
+
+    IROpcode* op;
+    Use* next;
+  };
+
+  void AddUse(IRVariable const& var, IROpcode* op) {
+    use_lists[var.id] = arena.New<Use>(op, use_lists[var.id]);
+  }
+
+  void AddUse(IRAnyRef const& value, IROpcode* op) {
+    if (value.IsVariable()) {
+      AddUse(value.GetVar(), op);
+    }
+  }
+
+  void AddUse(Optional<IRVariable const&> value, IROpcode* op) {
+    if (value.HasValue()) {
+      AddUse(value.Unwrap(), op);
+    }
+  }
+
+  template<typename T>
+  void AddUse(T const& argument, IROpcode* op) {}
+
+  ArenaAllocator arena;
   InstructionList code;
   VariableList variables;
+
+  /* Opcodes that use each variable, indexed by variable ID.
+   * Erased opcodes are only dropped from a list once it is walked.
+   * An opcode may appear more than once.
+   */
+  std::vector<Use*> use_lists;
 };
 
 } // namespace lunatic::frontend
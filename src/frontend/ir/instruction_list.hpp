@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+#include "opcode.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+/**
+ * Intrusive doubly linked list of IR opcodes.
+ * The list does not own the opcodes, they live in the arena of the IREmitter.
+ * Insertion and erasure take constant time and never invalidate iterators to other opcodes.
+ */
+struct IRInstructionList {
+  struct iterator {
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = IROpcode*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = IROpcode**;
+    using reference = IROpcode*;
+
+    iterator() = default;
+    iterator(IROpcode* op, IRInstructionList const* list) : op(op), list(list) {}
+
+    auto operator*() const -> IROpcode* { return op; }
+
+    auto operator++() -> iterator& {
+      op = op->next;
+      return *this;
+    }
+
+    auto operator--() -> iterator& {
+      // Decrementing end() yields the last opcode.
+      op = op ? op->prev : list->tail;
+      return *this;
+    }
+
+    auto operator++(int) -> iterator {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+
+    auto operator--(int) -> iterator {
+      auto it = *this;
+      --*this;
+      return it;
+    }
+
+    bool operator==(iterator const& other) const { return op == other.op; }
+    bool operator!=(iterator const& other) const { return op != other.op; }
+
+  private:
+    friend struct IRInstructionList;
+
+    IROpcode* op = nullptr;
+    IRInstructionList const* list = nullptr;
+  };
+
+  // Opcodes are mutable even through a const list, like std::list<std::unique_ptr<T>>.
+  using const_iterator = iterator;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = reverse_iterator;
+
+  IRInstructionList() = default;
+  IRInstructionList(IRInstructionList const&) = delete;
+  IRInstructionList& operator=(IRInstructionList const&) = delete;
+
+  IRInstructionList(IRInstructionList&& list) {
+    operator=(std::move(list));
+  }
+
+  IRInstructionList& operator=(IRInstructionList&& list) {
+    std::swap(head, list.head);
+    std::swap(tail, list.tail);
+    std::swap(length, list.length);
+    return *this;
+  }
+
+  auto begin() const -> iterator { return {head, this}; }
+  auto end() const -> iterator { return {nullptr, this}; }
+  auto rbegin() const -> reverse_iterator { return reverse_iterator{end()}; }
+  auto rend() const -> reverse_iterator { return reverse_iterator{begin()}; }
+
+  auto size() const -> size_t { return length; }
+  bool empty() const { return length == 0; }
+
+  void push_back(IROpcode* op) {
+    insert(end(), op);
+  }
+
+  /**
+   * Insert an opcode before another opcode.
+   *
+   * @param  position  the opcode to insert before, end() to append
+   * @param  op        the opcode to insert
+   * @returns an iterator to the inserted opcode
+   */
+  auto insert(iterator position, IROpcode* op) -> iterator {
+    auto next = position.op;
+    auto prev = next ? next->prev : tail;
+
+    op->prev = prev;
+    op->next = next;
+    op->erased = false;
+    (prev ? prev->next : head) = op;
+    (next ? next->prev : tail) = op;
+    length++;
+    return {op, this};
+  }
+
+  /**
+   * Unlink an opcode from the list and mark it as erased.
+   * Its memory is only released together with the arena of the IREmitter.
+   *
+   * @param  position  the opcode to erase
+   * @returns an iterator to the opcode that followed the erased opcode
+   */
+  auto erase(iterator position) -> iterator {
+    auto op = position.op;
+    auto next = op->next;
+
+    (op->prev ? op->prev->next : head) = next;
+    (next ? next->prev : tail) = op->prev;
+    op->prev = nullptr;
+    op->next = nullptr;
+    op->erased = true;
+    length--;
+    return {next, this};
+  }
+
+private:
+  friend struct IREmitter;
+
+  IROpcode* head = nullptr;
+  IROpcode* tail = nullptr;
+  size_t length = 0;
+};
+
+} // namespace lunatic::frontend
+} // namespace lunatic
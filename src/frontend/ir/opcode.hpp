@@ -10,7 +10,6 @@
 #include <fmt/format.h>
 #include <stdexcept>
 
-#include "common/pool_allocator.hpp"
 #include "register.hpp"
 #include "value.hpp"
 
@@ -60,24 +59,49 @@ enum class IROpcodeClass {
 // TODO: Reads(), Writes() and ToString() should be const,
 // but due to the nature of this Optional<T> implementation this is not possible at the moment.
 
-struct IROpcode : PoolObject {
-  virtual ~IROpcode() = default;
+/**
+ * Opcodes have no vtable, instead Visit() switches over the opcode class
+ * to call the methods of the actual opcode type.
+ * This keeps the opcodes trivially destructible, so that they can be released
+ * in bulk together with the arena that the IREmitter allocated them from.
+ */
+struct IROpcode {
+  auto GetClass() const -> IROpcodeClass { return klass; }
 
-  virtual auto GetClass() const -> IROpcodeClass = 0;
-  virtual auto Reads (IRVariable const& var) -> bool = 0;
-  virtual auto Writes(IRVariable const& var) -> bool = 0;
-  virtual void Repoint(
+  auto Reads (IRVariable const& var) -> bool;
+  auto Writes(IRVariable const& var) -> bool;
+  void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) = 0;
-  virtual auto ToString() -> std::string = 0;
+  );
+  auto ToString() -> std::string;
+
+  /// Call a function with a pointer to this opcode, cast to its actual type.
+  template<typename Fn>
+  auto Visit(Fn&& fn);
+
+  /// Whether the opcode was erased from the instruction list that it was inserted into.
+  bool IsErased() const { return erased; }
+
+protected:
+  IROpcode(IROpcodeClass klass) : klass(klass) {}
+
+private:
+  friend struct IRInstructionList;
+
+  IROpcodeClass klass;
+  bool erased = false;
+
+  // Links to the neighbouring opcodes in the instruction list.
+  IROpcode* prev = nullptr;
+  IROpcode* next = nullptr;
 };
 
 template<IROpcodeClass _klass>
 struct IROpcodeBase : IROpcode {
   static constexpr IROpcodeClass klass = _klass;
 
-  auto GetClass() const -> IROpcodeClass override { return _klass; }
+  IROpcodeBase() : IROpcode(_klass) {}
 };
 
 struct IRLoadGPR final : IROpcodeBase<IROpcodeClass::LoadGPR> {
@@ -89,22 +113,22 @@ struct IRLoadGPR final : IROpcodeBase<IROpcodeClass::LoadGPR> {
   IRGuestReg reg;
   IRVarRef result;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "ldgpr {}, {}",
       std::to_string(reg),
@@ -122,25 +146,25 @@ struct IRStoreGPR final : IROpcodeBase<IROpcodeClass::StoreGPR> {
   IRGuestReg reg;
   IRAnyRef value;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     if (value.IsVariable()) {
       return &var == &value.GetVar();
     }
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     value.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "stgpr {}, {}",
       std::to_string(reg),
@@ -158,22 +182,22 @@ struct IRLoadSPSR final : IROpcodeBase<IROpcodeClass::LoadSPSR> {
   IRVarRef result;
   Mode mode;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "ldspsr.{} {}",
       std::to_string(mode),
@@ -191,22 +215,22 @@ struct IRStoreSPSR final : IROpcodeBase<IROpcodeClass::StoreSPSR> {
   IRAnyRef value;
   Mode mode;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return value.IsVariable() && (&var == &value.GetVar());
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     value.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "stspsr.{} {}",
       std::to_string(mode),
@@ -221,22 +245,22 @@ struct IRLoadCPSR final : IROpcodeBase<IROpcodeClass::LoadCPSR> {
 
   IRVarRef result;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format("ldcpsr {}", std::to_string(result));
   }
 };
@@ -246,66 +270,66 @@ struct IRStoreCPSR final : IROpcodeBase<IROpcodeClass::StoreCPSR> {
 
   IRAnyRef value;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return value.IsVariable() && &var == &value.GetVar();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     value.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format("stcpsr {}", std::to_string(value));
   }
 };
 
 struct IRClearCarry final : IROpcodeBase<IROpcodeClass::ClearCarry> {
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     (void)var_old;
     (void)var_new;
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return "clearcarry";
   }
 };
 
 struct IRSetCarry final : IROpcodeBase<IROpcodeClass::SetCarry> {
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     (void)var_old;
     (void)var_new;
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return "setcarry";
   }
 };
@@ -333,23 +357,23 @@ struct IRUpdateFlags final : IROpcodeBase<IROpcodeClass::UpdateFlags> {
   bool flag_c;
   bool flag_v;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &input.Get() == &var;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &result.Get() == &var;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     input.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "update.{}{}{}{} {}, {}",
       flag_n ? 'n' : '-',
@@ -371,23 +395,23 @@ struct IRUpdateSticky final : IROpcodeBase<IROpcodeClass::UpdateSticky> {
   IRVarRef result;
   IRVarRef input;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &input.Get() == &var;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &result.Get() == &var;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     input.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "update.q {}, {}",
       std::to_string(result),
@@ -414,19 +438,19 @@ struct IRShifterBase : IROpcodeBase<_klass> {
   IRAnyRef amount;
   bool update_host_flags;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &operand.Get() ||
           (amount.IsVariable() && &var == &amount.GetVar());
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     operand.Repoint(var_old, var_new);
     amount.Repoint(var_old, var_new);
@@ -436,7 +460,7 @@ struct IRShifterBase : IROpcodeBase<_klass> {
 struct IRLogicalShiftLeft final : IRShifterBase<IROpcodeClass::LSL> {
   using IRShifterBase::IRShifterBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "lsl{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -450,7 +474,7 @@ struct IRLogicalShiftLeft final : IRShifterBase<IROpcodeClass::LSL> {
 struct IRLogicalShiftRight final : IRShifterBase<IROpcodeClass::LSR> {
   using IRShifterBase::IRShifterBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "lsr{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -464,7 +488,7 @@ struct IRLogicalShiftRight final : IRShifterBase<IROpcodeClass::LSR> {
 struct IRArithmeticShiftRight final : IRShifterBase<IROpcodeClass::ASR> {
   using IRShifterBase::IRShifterBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "asr{} {}, {}, {}",
       update_host_flags ? "s": "",
@@ -478,7 +502,7 @@ struct IRArithmeticShiftRight final : IRShifterBase<IROpcodeClass::ASR> {
 struct IRRotateRight final : IRShifterBase<IROpcodeClass::ROR> {
   using IRShifterBase::IRShifterBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "ror{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -507,19 +531,19 @@ struct IRBinaryOpBase : IROpcodeBase<_klass> {
   IRAnyRef rhs;
   bool update_host_flags;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &lhs.Get() == &var || 
           (rhs.IsVariable() && (&rhs.GetVar() == &var));
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return result.HasValue() && (&result.Unwrap() == &var);
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     // TODO: make this reusable?
     if (result.HasValue() && (&result.Unwrap() == &var_old)) {
       result = var_new;
@@ -533,7 +557,7 @@ struct IRBinaryOpBase : IROpcodeBase<_klass> {
 struct IRBitwiseAND final : IRBinaryOpBase<IROpcodeClass::AND> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "and{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -547,7 +571,7 @@ struct IRBitwiseAND final : IRBinaryOpBase<IROpcodeClass::AND> {
 struct IRBitwiseBIC final : IRBinaryOpBase<IROpcodeClass::BIC> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "bic{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -561,7 +585,7 @@ struct IRBitwiseBIC final : IRBinaryOpBase<IROpcodeClass::BIC> {
 struct IRBitwiseEOR final : IRBinaryOpBase<IROpcodeClass::EOR> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "eor{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -575,7 +599,7 @@ struct IRBitwiseEOR final : IRBinaryOpBase<IROpcodeClass::EOR> {
 struct IRSub final : IRBinaryOpBase<IROpcodeClass::SUB> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "sub{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -589,7 +613,7 @@ struct IRSub final : IRBinaryOpBase<IROpcodeClass::SUB> {
 struct IRRsb final : IRBinaryOpBase<IROpcodeClass::RSB> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "rsb{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -603,7 +627,7 @@ struct IRRsb final : IRBinaryOpBase<IROpcodeClass::RSB> {
 struct IRAdd final : IRBinaryOpBase<IROpcodeClass::ADD> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "add{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -617,7 +641,7 @@ struct IRAdd final : IRBinaryOpBase<IROpcodeClass::ADD> {
 struct IRAdc final : IRBinaryOpBase<IROpcodeClass::ADC> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "adc{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -631,7 +655,7 @@ struct IRAdc final : IRBinaryOpBase<IROpcodeClass::ADC> {
 struct IRSbc final : IRBinaryOpBase<IROpcodeClass::SBC> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "sbc{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -645,7 +669,7 @@ struct IRSbc final : IRBinaryOpBase<IROpcodeClass::SBC> {
 struct IRRsc final : IRBinaryOpBase<IROpcodeClass::RSC> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "rsc{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -659,7 +683,7 @@ struct IRRsc final : IRBinaryOpBase<IROpcodeClass::RSC> {
 struct IRBitwiseORR final : IRBinaryOpBase<IROpcodeClass::ORR> {
   using IRBinaryOpBase::IRBinaryOpBase;
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "orr{} {}, {}, {}",
       update_host_flags ? "s" : "",
@@ -684,23 +708,23 @@ struct IRMov final : IROpcodeBase<IROpcodeClass::MOV> {
   IRAnyRef source;
   bool update_host_flags;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return source.IsVariable() && (&source.GetVar() == &var);
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &result.Get() == &var;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     source.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "mov{} {}, {}",
       update_host_flags ? "s" : "",
@@ -724,23 +748,23 @@ struct IRMvn final : IROpcodeBase<IROpcodeClass::MVN> {
   IRAnyRef source;
   bool update_host_flags;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return source.IsVariable() && (&source.GetVar() == &var);
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &result.Get() == &var;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     source.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "mvn{} {}, {}",
       update_host_flags ? "s" : "",
@@ -770,11 +794,11 @@ struct IRMultiply final : IROpcodeBase<IROpcodeClass::MUL> {
   IRVarRef rhs;
   bool update_host_flags;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &lhs.Get() || &var == &rhs.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result_lo.Get() || 
           (result_hi.HasValue() && (&result_hi.Unwrap() == &var));
   }
@@ -782,7 +806,7 @@ struct IRMultiply final : IROpcodeBase<IROpcodeClass::MUL> {
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     if (result_hi.HasValue() && (&result_hi.Unwrap() == &var_old)) {
       result_hi = var_new;
     }
@@ -792,7 +816,7 @@ struct IRMultiply final : IROpcodeBase<IROpcodeClass::MUL> {
     rhs.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     std::string result_str;
 
     if (result_hi.HasValue()) {
@@ -841,21 +865,21 @@ struct IRAdd64 final : IROpcodeBase<IROpcodeClass::ADD64> {
   IRVarRef rhs_lo;
   bool update_host_flags;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &lhs_hi.Get() ||
            &var == &lhs_lo.Get() ||
            &var == &rhs_hi.Get() ||
            &var == &rhs_lo.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result_hi.Get() || &var == &result_lo.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result_hi.Repoint(var_old, var_new);
     result_lo.Repoint(var_old, var_new);
     lhs_hi.Repoint(var_old, var_new);
@@ -864,7 +888,7 @@ struct IRAdd64 final : IROpcodeBase<IROpcodeClass::ADD64> {
     rhs_lo.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "add{} ({}, {}), ({}, {}), ({}, {})",
       update_host_flags ? "s": "",
@@ -905,23 +929,23 @@ struct IRMemoryRead final : IROpcodeBase<IROpcodeClass::MemoryRead> {
   IRVarRef result;
   IRVarRef address;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &address.Get() == &var;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &result.Get() == &var;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     address.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     auto size = "b";
 
     if (flags & IRMemoryFlags::Half) size = "h";
@@ -951,23 +975,23 @@ struct IRMemoryWrite final : IROpcodeBase<IROpcodeClass::MemoryWrite> {
   IRVarRef source;
   IRVarRef address;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &address.Get() == &var || &source.Get() == &var;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     source.Repoint(var_old, var_new);
     address.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     auto size = "b";
 
     if (flags & IRMemoryFlags::Half) size = "h";
@@ -996,24 +1020,24 @@ struct IRFlush final : IROpcodeBase<IROpcodeClass::Flush> {
   IRVarRef address_in;
   IRVarRef cpsr_in;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &address_in.Get() || &var == &cpsr_in.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &address_out.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     address_out.Repoint(var_old, var_new);
     address_in.Repoint(var_old, var_new);
     cpsr_in.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "flush {}, {}, {}",
       std::to_string(address_out),
@@ -1040,25 +1064,25 @@ struct IRFlushExchange final : IROpcodeBase<IROpcodeClass::FlushExchange> {
   IRVarRef address_in;
   IRVarRef cpsr_in;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &address_in.Get() || &var == &cpsr_in.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &address_out.Get() || &var == &cpsr_out.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     address_out.Repoint(var_old, var_new);
     cpsr_out.Repoint(var_old, var_new);
     address_in.Repoint(var_old, var_new);
     cpsr_in.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "flushxchg {}, {}, {}, {}",
       std::to_string(address_out),
@@ -1078,23 +1102,23 @@ struct IRCountLeadingZeros final : IROpcodeBase<IROpcodeClass::CLZ> {
   IRVarRef result;
   IRVarRef operand;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &operand.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     operand.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "clz {}, {}",
       std::to_string(result),
@@ -1114,24 +1138,24 @@ struct IRSaturatingAdd final : IROpcodeBase<IROpcodeClass::QADD> {
   IRVarRef lhs;
   IRVarRef rhs;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &lhs.Get() || &var == &rhs.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     lhs.Repoint(var_old, var_new);
     rhs.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "qadd {}, {}, {}",
       std::to_string(result),
@@ -1152,24 +1176,24 @@ struct IRSaturatingSub final : IROpcodeBase<IROpcodeClass::QSUB> {
   IRVarRef lhs;
   IRVarRef rhs;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return &var == &lhs.Get() || &var == &rhs.Get();
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
     lhs.Repoint(var_old, var_new);
     rhs.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "qsub {}, {}, {}",
       std::to_string(result),
@@ -1202,22 +1226,22 @@ struct IRReadCoprocessorRegister final : IROpcodeBase<IROpcodeClass::MRC> {
   uint cm;
   uint opcode2;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return false;
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return &var == &result.Get();
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     result.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "mrc {}, cp{}, #{}, {}, {}, #{}",
       std::to_string(result),
@@ -1253,22 +1277,22 @@ struct IRWriteCoprocessorRegister final : IROpcodeBase<IROpcodeClass::MCR> {
   uint cm;
   uint opcode2;
 
-  auto Reads(IRVariable const& var) -> bool override {
+  auto Reads(IRVariable const& var) -> bool {
     return value.IsVariable() && (&value.GetVar() == &var);
   }
 
-  auto Writes(IRVariable const& var) -> bool override {
+  auto Writes(IRVariable const& var) -> bool {
     return false;
   }
 
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
-  ) override {
+  ) {
     value.Repoint(var_old, var_new);
   }
 
-  auto ToString() -> std::string override {
+  auto ToString() -> std::string {
     return fmt::format(
       "mcr {}, cp{}, #{}, {}, {}, #{}",
       std::to_string(value),
@@ -1281,6 +1305,70 @@ struct IRWriteCoprocessorRegister final : IROpcodeBase<IROpcodeClass::MCR> {
   }
 };
 
+template<typename Fn>
+auto IROpcode::Visit(Fn&& fn) {
+  switch (klass) {
+    case IROpcodeClass::LoadGPR: return fn(static_cast<IRLoadGPR*>(this));
+    case IROpcodeClass::StoreGPR: return fn(static_cast<IRStoreGPR*>(this));
+    case IROpcodeClass::LoadSPSR: return fn(static_cast<IRLoadSPSR*>(this));
+    case IROpcodeClass::StoreSPSR: return fn(static_cast<IRStoreSPSR*>(this));
+    case IROpcodeClass::LoadCPSR: return fn(static_cast<IRLoadCPSR*>(this));
+    case IROpcodeClass::StoreCPSR: return fn(static_cast<IRStoreCPSR*>(this));
+    case IROpcodeClass::ClearCarry: return fn(static_cast<IRClearCarry*>(this));
+    case IROpcodeClass::SetCarry: return fn(static_cast<IRSetCarry*>(this));
+    case IROpcodeClass::UpdateFlags: return fn(static_cast<IRUpdateFlags*>(this));
+    case IROpcodeClass::UpdateSticky: return fn(static_cast<IRUpdateSticky*>(this));
+    case IROpcodeClass::LSL: return fn(static_cast<IRLogicalShiftLeft*>(this));
+    case IROpcodeClass::LSR: return fn(static_cast<IRLogicalShiftRight*>(this));
+    case IROpcodeClass::ASR: return fn(static_cast<IRArithmeticShiftRight*>(this));
+    case IROpcodeClass::ROR: return fn(static_cast<IRRotateRight*>(this));
+    case IROpcodeClass::AND: return fn(static_cast<IRBitwiseAND*>(this));
+    case IROpcodeClass::BIC: return fn(static_cast<IRBitwiseBIC*>(this));
+    case IROpcodeClass::EOR: return fn(static_cast<IRBitwiseEOR*>(this));
+    case IROpcodeClass::SUB: return fn(static_cast<IRSub*>(this));
+    case IROpcodeClass::RSB: return fn(static_cast<IRRsb*>(this));
+    case IROpcodeClass::ADD: return fn(static_cast<IRAdd*>(this));
+    case IROpcodeClass::ADC: return fn(static_cast<IRAdc*>(this));
+    case IROpcodeClass::SBC: return fn(static_cast<IRSbc*>(this));
+    case IROpcodeClass::RSC: return fn(static_cast<IRRsc*>(this));
+    case IROpcodeClass::ORR: return fn(static_cast<IRBitwiseORR*>(this));
+    case IROpcodeClass::MOV: return fn(static_cast<IRMov*>(this));
+    case IROpcodeClass::MVN: return fn(static_cast<IRMvn*>(this));
+    case IROpcodeClass::MUL: return fn(static_cast<IRMultiply*>(this));
+    case IROpcodeClass::ADD64: return fn(static_cast<IRAdd64*>(this));
+    case IROpcodeClass::MemoryRead: return fn(static_cast<IRMemoryRead*>(this));
+    case IROpcodeClass::MemoryWrite: return fn(static_cast<IRMemoryWrite*>(this));
+    case IROpcodeClass::Flush: return fn(static_cast<IRFlush*>(this));
+    case IROpcodeClass::FlushExchange: return fn(static_cast<IRFlushExchange*>(this));
+    case IROpcodeClass::CLZ: return fn(static_cast<IRCountLeadingZeros*>(this));
+    case IROpcodeClass::QADD: return fn(static_cast<IRSaturatingAdd*>(this));
+    case IROpcodeClass::QSUB: return fn(static_cast<IRSaturatingSub*>(this));
+    case IROpcodeClass::MRC: return fn(static_cast<IRReadCoprocessorRegister*>(this));
+    case IROpcodeClass::MCR: return fn(static_cast<IRWriteCoprocessorRegister*>(this));
+  }
+
+  throw std::runtime_error(fmt::format("IROpcode: unknown opcode class {}", (int)klass));
+}
+
+inline auto IROpcode::Reads(IRVariable const& var) -> bool {
+  return Visit([&](auto op) { return op->Reads(var); });
+}
+
+inline auto IROpcode::Writes(IRVariable const& var) -> bool {
+  return Visit([&](auto op) { return op->Writes(var); });
+}
+
+inline void IROpcode::Repoint(
+  IRVariable const& var_old,
+  IRVariable const& var_new
+) {
+  Visit([&](auto op) { op->Repoint(var_old, var_new); });
+}
+
+inline auto IROpcode::ToString() -> std::string {
+  return Visit([](auto op) { return op->ToString(); });
+}
+
 } // namespace lunatic::frontend
 } // namespace lunatic
 
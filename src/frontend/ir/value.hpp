@@ -12,7 +12,6 @@
 #include <stdexcept>
 
 #include "common/optional.hpp"
-#include "common/pool_allocator.hpp"
 
 namespace lunatic {
 namespace frontend {
@@ -23,7 +22,7 @@ enum class IRDataType {
 };
 
 /// Represents an immutable variable
-struct IRVariable : PoolObject {
+struct IRVariable {
   IRVariable(IRVariable const& other) = delete;
 
   /// ID that is unique inside the IREmitter instance.
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <algorithm>
+#include <lunatic/detail/punning.hpp>
+
+#include "common/bit.hpp"
+#include "frontend/ir_opt/constant_propagation.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+void IRConstantPropagationPass::Run(IREmitter& emitter) {
+  auto& code = emitter.Code();
+  auto constants = Constants(emitter.Vars().size());
+
+  for (auto it = code.begin(); it != code.end(); ++it) {
+    auto op = *it;
+
+    Propagate(op, constants);
+
+    if (op->GetClass() == IROpcodeClass::MOV) {
+      auto mov = lunatic_cast<IRMov>(op);
+
+      if (mov->source.IsConstant() && !mov->update_host_flags) {
+        constants[mov->result.Get().id] = mov->source.GetConst().value;
+      }
+      continue;
+    }
+
+    auto result = Result{};
+    auto value = Evaluate(op, constants, result);
+
+    if (value.HasValue()) {
+      auto& result_var = result.Unwrap();
+
+      /* The result may still be read by opcodes which do not accept constant operands.
+       * Keep it in a variable for now and remove the move later if it turns out to be unused.
+       */
+      constants[result_var.id] = value;
+      it = code.erase(it);
+      it = code.insert(it, emitter.CreateOp<IRMov>(result_var, IRConstant{value.Unwrap()}, false));
+    }
+  }
+
+  RemoveUnusedConstants(emitter);
+}
+
+void IRConstantPropagationPass::Propagate(IROpcode* op, Constants const& constants) {
+  auto propagate = [&](IRAnyRef& value) {
+    auto constant = GetConst(constants, value);
+
+    if (constant.HasValue()) {
+      value = IRConstant{constant.Unwrap()};
+    }
+  };
+
+  /* Shift amounts are left alone on purpose, because a constant amount of zero
+   * has a different meaning than a variable amount of zero (i.e. LSR #0 is LSR #32).
+   */
+  switch (op->GetClass()) {
+    case IROpcodeClass::StoreGPR: propagate(lunatic_cast<IRStoreGPR>(op)->value); break;
+    case IROpcodeClass::StoreSPSR: propagate(lunatic_cast<IRStoreSPSR>(op)->value); break;
+    case IROpcodeClass::StoreCPSR: propagate(lunatic_cast<IRStoreCPSR>(op)->value); break;
+    case IROpcodeClass::AND: propagate(lunatic_cast<IRBitwiseAND>(op)->rhs); break;
+    case IROpcodeClass::BIC: propagate(lunatic_cast<IRBitwiseBIC>(op)->rhs); break;
+    case IROpcodeClass::EOR: propagate(lunatic_cast<IRBitwiseEOR>(op)->rhs); break;
+    case IROpcodeClass::SUB: propagate(lunatic_cast<IRSub>(op)->rhs); break;
+    case IROpcodeClass::RSB: propagate(lunatic_cast<IRRsb>(op)->rhs); break;
+    case IROpcodeClass::ADD: propagate(lunatic_cast<IRAdd>(op)->rhs); break;
+    case IROpcodeClass::ADC: propagate(lunatic_cast<IRAdc>(op)->rhs); break;
+    case IROpcodeClass::SBC: propagate(lunatic_cast<IRSbc>(op)->rhs); break;
+    case IROpcodeClass::RSC: propagate(lunatic_cast<IRRsc>(op)->rhs); break;
+    case IROpcodeClass::ORR: propagate(lunatic_cast<IRBitwiseORR>(op)->rhs); break;
+    case IROpcodeClass::MOV: propagate(lunatic_cast<IRMov>(op)->source); break;
+    case IROpcodeClass::MVN: propagate(lunatic_cast<IRMvn>(op)->source); break;
+    case IROpcodeClass::MCR: propagate(lunatic_cast<IRWriteCoprocessorRegister>(op)->value); break;
+    default: break;
+  }
+}
+
+auto IRConstantPropagationPass::Evaluate(IROpcode* op, Constants const& constants, Result& result) -> Optional<u32> {
+  switch (op->GetClass()) {
+    case IROpcodeClass::AND: return EvaluateBinaryOp<IRBitwiseAND>(op, constants, result, [](u32 lhs, u32 rhs) { return lhs & rhs; });
+    case IROpcodeClass::BIC: return EvaluateBinaryOp<IRBitwiseBIC>(op, constants, result, [](u32 lhs, u32 rhs) { return lhs & ~rhs; });
+    case IROpcodeClass::EOR: return EvaluateBinaryOp<IRBitwiseEOR>(op, constants, result, [](u32 lhs, u32 rhs) { return lhs ^ rhs; });
+    case IROpcodeClass::SUB: return EvaluateBinaryOp<IRSub>(op, constants, result, [](u32 lhs, u32 rhs) { return lhs - rhs; });
+    case IROpcodeClass::RSB: return EvaluateBinaryOp<IRRsb>(op, constants, result, [](u32 lhs, u32 rhs) { return rhs - lhs; });
+    case IROpcodeClass::ADD: return EvaluateBinaryOp<IRAdd>(op, constants, result, [](u32 lhs, u32 rhs) { return lhs + rhs; });
+    case IROpcodeClass::ORR: return EvaluateBinaryOp<IRBitwiseORR>(op, constants, result, [](u32 lhs, u32 rhs) { return lhs | rhs; });
+    case IROpcodeClass::LSL: return EvaluateShift<IRLogicalShiftLeft>(op, constants, result);
+    case IROpcodeClass::LSR: return EvaluateShift<IRLogicalShiftRight>(op, constants, result);
+    case IROpcodeClass::ASR: return EvaluateShift<IRArithmeticShiftRight>(op, constants, result);
+    case IROpcodeClass::ROR: return EvaluateShift<IRRotateRight>(op, constants, result);
+    case IROpcodeClass::MVN: {
+      auto mvn = lunatic_cast<IRMvn>(op);
+      auto source = GetConst(constants, mvn->source);
+
+      if (mvn->update_host_flags || source.IsNull()) {
+        return {};
+      }
+      result = mvn->result.Get();
+      return ~source.Unwrap();
+    }
+    case IROpcodeClass::CLZ: {
+      auto clz = lunatic_cast<IRCountLeadingZeros>(op);
+      auto operand = GetConst(constants, clz->operand.Get());
+
+      if (operand.IsNull()) {
+        return {};
+      }
+      result = clz->result.Get();
+      return bit::count_leading_zeros(operand.Unwrap());
+    }
+    case IROpcodeClass::MemoryRead: return EvaluateMemoryRead(op, constants, result);
+    default: return {};
+  }
+}
+
+template<typename T, typename Fn>
+auto IRConstantPropagationPass::EvaluateBinaryOp(IROpcode* op, Constants const& constants, Result& result, Fn fn) -> Optional<u32> {
+  auto binary_op = lunatic_cast<T>(op);
+
+  // Opcodes that update the host flags must be kept for the flags.
+  if (binary_op->update_host_flags || binary_op->result.IsNull()) {
+    return {};
+  }
+
+  auto lhs = GetConst(constants, binary_op->lhs.Get());
+  auto rhs = GetConst(constants, binary_op->rhs);
+
+  if (lhs.IsNull() || rhs.IsNull()) {
+    return {};
+  }
+
+  result = binary_op->result.Unwrap();
+  return fn(lhs.Unwrap(), rhs.Unwrap());
+}
+
+template<typename T>
+auto IRConstantPropagationPass::EvaluateShift(IROpcode* op, Constants const& constants, Result& result) -> Optional<u32> {
+  auto shift = lunatic_cast<T>(op);
+
+  if (shift->update_host_flags) {
+    return {};
+  }
+
+  auto operand = GetConst(constants, shift->operand.Get());
+  auto amount = GetConst(constants, shift->amount);
+
+  if (operand.IsNull() || amount.IsNull()) {
+    return {};
+  }
+
+  auto value = operand.Unwrap();
+  auto count = amount.Unwrap();
+
+  // Follow the semantics of the backend, which differ between constant and variable shift amounts.
+  if (shift->amount.IsConstant()) {
+    if (count == 0) {
+      // ROR #0 is RRX, which reads the carry flag.
+      if constexpr (T::klass == IROpcodeClass::ROR) {
+        return {};
+      }
+
+      // LSR #0 and ASR #0 equal LSR #32 and ASR #32
+      if constexpr (T::klass == IROpcodeClass::LSR || T::klass == IROpcodeClass::ASR) {
+        count = 32;
+      }
+    }
+  } else if constexpr (T::klass != IROpcodeClass::ROR) {
+    count &= 0xFF;
+
+    if (count >= 0x80) {
+      return {};
+    }
+  }
+
+  result = shift->result.Get();
+
+  switch (T::klass) {
+    case IROpcodeClass::LSL: return count >= 32 ? 0 : value << count;
+    case IROpcodeClass::LSR: return count >= 32 ? 0 : value >> count;
+    case IROpcodeClass::ASR: return u32(s32(value) >> std::min(count, 31U));
+    default: return bit::rotate_right<u32>(value, count & 31);
+  }
+}
+
+auto IRConstantPropagationPass::EvaluateMemoryRead(IROpcode* op, Constants const& constants, Result& result) -> Optional<u32> {
+  auto read = lunatic_cast<IRMemoryRead>(op);
+  auto maybe_address = GetConst(constants, read->address.Get());
+
+  if (maybe_address.IsNull() || !memory.read_only_pages || !memory.pagetable) {
+    return {};
+  }
+
+  auto address = maybe_address.Unwrap();
+  auto page_index = address >> Memory::kPageShift;
+
+  if (((*memory.read_only_pages)[page_index >> 5] & (1U << (page_index & 31))) == 0) {
+    return {};
+  }
+
+  // The TCMs take priority over the page table.
+  for (auto tcm : {&memory.itcm, &memory.dtcm}) {
+    if (tcm->config.enable_read && address >= tcm->config.base && address <= tcm->config.limit) {
+      return {};
+    }
+  }
+
+  auto page = (*memory.pagetable)[page_index];
+
+  if (page == nullptr) {
+    return {};
+  }
+
+  auto flags = read->flags;
+  u32 value;
+
+  if (flags & Word) {
+    value = lunatic::read<u32>(page, address & Memory::kPageMask & ~3);
+  } else if (flags & Half) {
+    value = lunatic::read<u16>(page, address & Memory::kPageMask & ~1);
+    if (flags & Signed) {
+      value = u32(s16(value));
+    }
+  } else {
+    value = lunatic::read<u8>(page, address & Memory::kPageMask);
+    if (flags & Signed) {
+      value = u32(s8(value));
+    }
+  }
+
+  if (flags & Rotate) {
+    if (flags & Word) {
+      value = bit::rotate_right<u32>(value, (address & 3) * 8);
+    } else if (flags & Half) {
+      value = bit::rotate_right<u32>(value, (address & 1) * 8);
+    }
+  }
+
+  // ARM7TDMI/ARMv4T special case: unaligned LDRSH is effectively LDRSB.
+  if ((flags & (Half | Signed | ARMv4T)) == (Half | Signed | ARMv4T) && (address & 1)) {
+    value = u32(s8(value >> 8));
+  }
+
+  result = read->result.Get();
+  return value;
+}
+
+void IRConstantPropagationPass::RemoveUnusedConstants(IREmitter& emitter) {
+  auto& code = emitter.Code();
+  auto it = code.begin();
+
+  while (it != code.end()) {
+    if ((*it)->GetClass() == IROpcodeClass::MOV) {
+      auto mov = lunatic_cast<IRMov>(*it);
+
+      if (mov->source.IsConstant() && !mov->update_host_flags && !emitter.IsRead(mov->result.Get())) {
+        it = code.erase(it);
+        continue;
+      }
+    }
+
+    ++it;
+  }
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
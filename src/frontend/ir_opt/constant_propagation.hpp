@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <lunatic/memory.hpp>
+#include <vector>
+
+#include "frontend/ir_opt/pass.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+struct IRConstantPropagationPass final : IRPass {
+  IRConstantPropagationPass(Memory& memory) : memory(memory) {}
+
+  void Run(IREmitter& emitter) override;
+
+private:
+  using Result = Optional<IRVariable const&>;
+
+  /* Map variable to its value, if it is known at compile time.
+   * Kept out of the pass itself, because the pass may run on multiple threads at once.
+   */
+  using Constants = std::vector<Optional<u32>>;
+
+  /// Replace operands that are known to be constant with the constant value, where the backend allows it.
+  void Propagate(IROpcode* op, Constants const& constants);
+
+  /**
+   * Evaluate an opcode, if all of its inputs are known at compile time and it has no side effects.
+   *
+   * @param  op      the opcode
+   * @param  result  receives the variable that holds the result of the opcode
+   * @returns the value of the result
+   */
+  auto Evaluate(IROpcode* op, Constants const& constants, Result& result) -> Optional<u32>;
+
+  template<typename T, typename Fn>
+  auto EvaluateBinaryOp(IROpcode* op, Constants const& constants, Result& result, Fn fn) -> Optional<u32>;
+
+  template<typename T>
+  auto EvaluateShift(IROpcode* op, Constants const& constants, Result& result) -> Optional<u32>;
+
+  auto EvaluateMemoryRead(IROpcode* op, Constants const& constants, Result& result) -> Optional<u32>;
+
+  /// Remove moves of constants into variables that are no longer read after propagation.
+  void RemoveUnusedConstants(IREmitter& emitter);
+
+  static auto GetConst(Constants const& constants, IRVariable const& var) -> Optional<u32> {
+    return constants[var.id];
+  }
+
+  static auto GetConst(Constants const& constants, IRAnyRef const& value) -> Optional<u32> {
+    if (value.IsConstant()) {
+      return value.GetConst().value;
+    }
+    if (value.IsVariable()) {
+      return GetConst(constants, value.GetVar());
+    }
+    return {};
+  }
+
+  Memory& memory;
+};
+
+} // namespace lunatic::frontend
+} // namespace lunatic
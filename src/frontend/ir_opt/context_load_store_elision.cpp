@@ -10,12 +10,47 @@
 namespace lunatic {
 namespace frontend {
 
-void IRContextLoadStoreElisionPass::Run(IREmitter& emitter) {
+void IRContextLoadStoreElisionPass::Run(BasicBlock& basic_block) {
+  auto& micro_blocks = basic_block.micro_blocks;
+  auto overwritten = Overwritten{};
+
   // Forward pass: remove redundant GPR and CPSR reads
-  RemoveLoads(emitter);
+  for (auto& micro_block : micro_blocks) {
+    RemoveLoads(micro_block.emitter);
+  }
+
+  /* Backward pass: remove redundant GPR and CPSR stores, including stores
+   * which are overwritten by a later micro block before they can be observed.
+   */
+  for (auto it = micro_blocks.rbegin(); it != micro_blocks.rend(); ++it) {
+    auto& micro_block = *it;
+    auto overwritten_if_skipped = overwritten;
+
+    // The side exit leaves the basic block, which makes the whole context visible.
+    if (micro_block.side_exit.key.value != 0) {
+      overwritten = {};
+    }
+
+    RemoveStores(micro_block.emitter, overwritten);
+
+    /* A store is only overwritten if it is overwritten on both paths past a conditional micro block.
+     * Checking the condition reads the CPSR and skipping the micro block updates the program counter.
+     */
+    if (micro_block.condition != Condition::AL) {
+      for (int i = 0; i < 512; i++) {
+        overwritten.gpr[i] = overwritten.gpr[i] && overwritten_if_skipped.gpr[i];
+      }
+      overwritten.gpr[static_cast<int>(GPR::PC)] = false;
+      overwritten.cpsr = false;
+    }
+  }
+}
+
+void IRContextLoadStoreElisionPass::Run(IREmitter& emitter) {
+  auto overwritten = Overwritten{};
 
-  // Backward pass: remove redundant GPR and CPSR stores
-  RemoveStores(emitter);
+  RemoveLoads(emitter);
+  RemoveStores(emitter, overwritten);
 }
 
 void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
@@ -26,20 +61,20 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
   IRAnyRef current_cpsr_value;
 
   auto Move = [&](IRVariable const& dst, IRAnyRef src) {
-    code.insert(it, std::make_unique<IRMov>(dst, src, false));
+    code.insert(it, emitter.CreateOp<IRMov>(dst, src, false));
   };
 
   while (it != end) {
-    switch (it->get()->GetClass()) {
+    switch ((*it)->GetClass()) {
       case IROpcodeClass::StoreGPR: {
-        auto op = lunatic_cast<IRStoreGPR>(it->get());
+        auto op = lunatic_cast<IRStoreGPR>((*it));
         auto gpr_id = op->reg.ID();
 
         current_gpr_value[gpr_id] = op->value;
         break;
       }
       case IROpcodeClass::LoadGPR: {
-        auto  op = lunatic_cast<IRLoadGPR>(it->get());
+        auto  op = lunatic_cast<IRLoadGPR>((*it));
         auto  gpr_id  = op->reg.ID();
         auto  var_src = current_gpr_value[gpr_id];
         auto& var_dst = op->result.Get();
@@ -47,8 +82,8 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
         if (!var_src.IsNull()) {
           it = code.erase(it);
 
-          // TODO: if var_src is constant attempt updating IRAnyRefs.
-          if (var_src.IsConstant() || !Repoint(var_dst, var_src.GetVar(), it, end)) {
+          // Constants are propagated further by IRConstantPropagationPass.
+          if (var_src.IsConstant() || !emitter.Repoint(var_dst, var_src.GetVar())) {
             Move(var_dst, var_src);
           }
           continue;
@@ -58,19 +93,19 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
         break;
       }
       case IROpcodeClass::StoreCPSR: {
-        current_cpsr_value = lunatic_cast<IRStoreCPSR>(it->get())->value;
+        current_cpsr_value = lunatic_cast<IRStoreCPSR>((*it))->value;
         break;
       }
       case IROpcodeClass::LoadCPSR: {
-        auto  op = lunatic_cast<IRLoadCPSR>(it->get());
+        auto  op = lunatic_cast<IRLoadCPSR>((*it));
         auto  var_src = current_cpsr_value;
         auto& var_dst = op->result.Get();
 
         if (!var_src.IsNull()) {
           it = code.erase(it);
 
-          // TODO: if var_src is constant attempt updating IRAnyRefs.
-          if (var_src.IsConstant() || !Repoint(var_dst, var_src.GetVar(), it, end)) {
+          // Constants are propagated further by IRConstantPropagationPass.
+          if (var_src.IsConstant() || !emitter.Repoint(var_dst, var_src.GetVar())) {
             Move(var_dst, var_src);
           }
           continue;
@@ -88,17 +123,17 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
   }
 }
 
-void IRContextLoadStoreElisionPass::RemoveStores(IREmitter& emitter) {
+void IRContextLoadStoreElisionPass::RemoveStores(IREmitter& emitter, Overwritten& overwritten) {
   auto& code = emitter.Code();
   auto it = code.rbegin();
   auto end = code.rend();
-  bool gpr_already_stored[512] {false};
-  bool cpsr_already_stored = false;
+  auto& gpr_already_stored = overwritten.gpr;
+  auto& cpsr_already_stored = overwritten.cpsr;
 
   while (it != end) {
-    switch (it->get()->GetClass()) {
+    switch ((*it)->GetClass()) {
       case IROpcodeClass::StoreGPR: {
-        auto op = lunatic_cast<IRStoreGPR>(it->get());
+        auto op = lunatic_cast<IRStoreGPR>((*it));
         auto gpr_id = op->reg.ID();
 
         if (gpr_already_stored[gpr_id]) {
@@ -110,6 +145,10 @@ void IRContextLoadStoreElisionPass::RemoveStores(IREmitter& emitter) {
         }
         break;
       }
+      case IROpcodeClass::LoadGPR: {
+        gpr_already_stored[lunatic_cast<IRLoadGPR>((*it))->reg.ID()] = false;
+        break;
+      }
       case IROpcodeClass::StoreCPSR: {
         if (cpsr_already_stored) {
           it = std::reverse_iterator{code.erase(std::next(it).base())};
@@ -120,6 +159,10 @@ void IRContextLoadStoreElisionPass::RemoveStores(IREmitter& emitter) {
         }
         break;
       }
+      case IROpcodeClass::LoadCPSR: {
+        cpsr_already_stored = false;
+        break;
+      }
       default: {
         break;
       }
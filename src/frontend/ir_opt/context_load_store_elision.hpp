@@ -13,11 +13,26 @@ namespace lunatic {
 namespace frontend {
 
 struct IRContextLoadStoreElisionPass final : IRPass {
+  void Run(BasicBlock& basic_block) override;
   void Run(IREmitter& emitter) override;
 
 private:
+  // Context registers which are written again before they are read.
+  struct Overwritten {
+    bool gpr[512] {false};
+    bool cpsr = false;
+  };
+
   void RemoveLoads(IREmitter& emitter);
-  void RemoveStores(IREmitter& emitter);
+
+  /**
+   * Remove stores to context registers that are overwritten before they are read.
+   *
+   * @param  emitter      the code to optimize
+   * @param  overwritten  the registers overwritten after the code,
+   *                      receives the registers overwritten from the start of the code.
+   */
+  void RemoveStores(IREmitter& emitter, Overwritten& overwritten);
 };
 
 } // namespace lunatic::frontend
@@ -16,13 +16,13 @@ void IRDeadCodeElisionPass::Run(IREmitter& emitter) {
   auto end = code.end();
 
   while (it != end) {
-    switch (it->get()->GetClass()) {
+    switch ((*it)->GetClass()) {
     	// ADD #0 is a no-operation
       case IROpcodeClass::ADD: {
-        auto op = lunatic_cast<IRAdd>(it->get());
+        auto op = lunatic_cast<IRAdd>((*it));
 
         if (op->result.HasValue() && op->rhs.IsConstant() && op->rhs.GetConst().value == 0 && !op->update_host_flags) {
-          if (Repoint(op->result.Unwrap(), op->lhs.Get(), it, end)) {
+          if (emitter.Repoint(op->result.Unwrap(), op->lhs.Get())) {
             it = code.erase(it);
             continue;
           }
@@ -31,10 +31,10 @@ void IRDeadCodeElisionPass::Run(IREmitter& emitter) {
       }
       // LSL(S) #0 is a no-operation
       case IROpcodeClass::LSL: {
-        auto op = lunatic_cast<IRLogicalShiftLeft>(it->get());
+        auto op = lunatic_cast<IRLogicalShiftLeft>((*it));
         
         if (op->amount.IsConstant() && op->amount.GetConst().value == 0) {
-          if (Repoint(op->result.Get(), op->operand.Get(), it, end)) {
+          if (emitter.Repoint(op->result.Get(), op->operand.Get())) {
             it = code.erase(it);
             continue;
           }
@@ -43,10 +43,10 @@ void IRDeadCodeElisionPass::Run(IREmitter& emitter) {
       }
       // MOV var_a, var_b: var_a is a redundant variable.
       case IROpcodeClass::MOV: {
-        auto op = lunatic_cast<IRMov>(it->get());
+        auto op = lunatic_cast<IRMov>((*it));
 
         if (op->source.IsVariable() && !op->update_host_flags) {
-          if (Repoint(op->result.Get(), op->source.GetVar(), it, end)) {
+          if (emitter.Repoint(op->result.Get(), op->source.GetVar())) {
             it = code.erase(it);
             continue;
           }
@@ -11,7 +11,39 @@
 namespace lunatic {
 namespace frontend {
 
+void IRDeadFlagElisionPass::Run(BasicBlock& basic_block) {
+  auto& micro_blocks = basic_block.micro_blocks;
+
+  // All flags are visible once the basic block is left.
+  auto unused = Flags{};
+
+  for (auto it = micro_blocks.rbegin(); it != micro_blocks.rend(); ++it) {
+    auto& micro_block = *it;
+    auto unused_if_skipped = unused;
+
+    if (micro_block.side_exit.key.value != 0) {
+      unused = {};
+    }
+
+    unused = Elide(micro_block.emitter, unused);
+
+    // A flag is only unused if it is unused on both paths past a conditional micro block.
+    if (micro_block.condition != Condition::AL) {
+      auto read = GetFlagsRead(micro_block.condition);
+
+      unused.n = unused.n && unused_if_skipped.n && !read.n;
+      unused.z = unused.z && unused_if_skipped.z && !read.z;
+      unused.c = unused.c && unused_if_skipped.c && !read.c;
+      unused.v = unused.v && unused_if_skipped.v && !read.v;
+    }
+  }
+}
+
 void IRDeadFlagElisionPass::Run(IREmitter& emitter) {
+  Elide(emitter, {});
+}
+
+auto IRDeadFlagElisionPass::Elide(IREmitter& emitter, Flags unused_at_exit) -> Flags {
   /**
    * TODO:
    * a) implement the same logic for the Q-flag (update.q)
@@ -30,10 +62,52 @@ void IRDeadFlagElisionPass::Run(IREmitter& emitter) {
 
   Optional<IRVariable const&> current_cpsr_in{};
 
+  // Without any CPSR access the flags pass through the code unchanged.
+  auto unused_at_entry = unused_at_exit;
+  bool stored_cpsr = false;
+
   while (it != end) {
-    switch (it->get()->GetClass()) {
+    switch ((*it)->GetClass()) {
+      case IROpcodeClass::StoreCPSR: {
+        auto op = lunatic_cast<IRStoreCPSR>((*it));
+
+        // The last CPSR store decides which flags are visible after the code.
+        if (!stored_cpsr) {
+          stored_cpsr = true;
+          unused_at_entry = {true, true, true, true};
+
+          if (op->value.IsVariable()) {
+            current_cpsr_in = op->value.GetVar();
+            unused_n = unused_at_exit.n;
+            unused_z = unused_at_exit.z;
+            unused_c = unused_at_exit.c;
+            unused_v = unused_at_exit.v;
+          }
+          break;
+        }
+
+        if (current_cpsr_in.HasValue() && op->Reads(current_cpsr_in.Unwrap())) {
+          unused_n = false;
+          unused_z = false;
+          unused_c = false;
+          unused_v = false;
+          current_cpsr_in = {};
+        }
+        break;
+      }
+      case IROpcodeClass::LoadCPSR: {
+        auto& result = lunatic_cast<IRLoadCPSR>((*it))->result.Get();
+
+        // Flags of the loaded CPSR value that are overwritten before they are read are unused at the start.
+        if (current_cpsr_in.HasValue() && &current_cpsr_in.Unwrap() == &result) {
+          unused_at_entry = {unused_n, unused_z, unused_c, unused_v};
+        } else {
+          unused_at_entry = {};
+        }
+        break;
+      }
       case IROpcodeClass::UpdateFlags: {
-        auto op = lunatic_cast<IRUpdateFlags>(it->get());
+        auto op = lunatic_cast<IRUpdateFlags>((*it));
 
         if (current_cpsr_in.HasValue() && op->Writes(current_cpsr_in.Unwrap())) {
           if (unused_n) op->flag_n = false;
@@ -43,8 +117,7 @@ void IRDeadFlagElisionPass::Run(IREmitter& emitter) {
 
           // Elide update.nzcv opcodes that now don't update any flag.
           if (!op->flag_n && !op->flag_z && !op->flag_c && !op->flag_v) {
-            // TODO: do not use begin()?
-            if (Repoint(op->result.Get(), op->input.Get(), code.begin(), code.end())) {
+            if (emitter.Repoint(op->result.Get(), op->input.Get())) {
               current_cpsr_in = op->input.Get();
               it = std::reverse_iterator{code.erase(std::next(it).base())};
               end = code.rend();
@@ -63,7 +136,7 @@ void IRDeadFlagElisionPass::Run(IREmitter& emitter) {
         break;
       }
       default: {
-        if (current_cpsr_in.HasValue() && it->get()->Reads(current_cpsr_in.Unwrap())) {
+        if (current_cpsr_in.HasValue() && (*it)->Reads(current_cpsr_in.Unwrap())) {
           /* We are reading the CPSR value between two NZCV updates.
            * This means that the first NZCV update must update all flags,
            * otherwise this opcode will read the wrong CPSR value.
@@ -80,6 +153,28 @@ void IRDeadFlagElisionPass::Run(IREmitter& emitter) {
 
     ++it;
   }
+
+  return unused_at_entry;
+}
+
+auto IRDeadFlagElisionPass::GetFlagsRead(Condition condition) -> Flags {
+  switch (condition) {
+    case Condition::EQ:
+    case Condition::NE: return {false, true, false, false};
+    case Condition::CS:
+    case Condition::CC: return {false, false, true, false};
+    case Condition::MI:
+    case Condition::PL: return {true, false, false, false};
+    case Condition::VS:
+    case Condition::VC: return {false, false, false, true};
+    case Condition::HI:
+    case Condition::LS: return {false, true, true, false};
+    case Condition::GE:
+    case Condition::LT: return {true, false, false, true};
+    case Condition::GT:
+    case Condition::LE: return {true, true, false, true};
+    default: return {};
+  }
 }
 
 } // namespace lunatic::frontend
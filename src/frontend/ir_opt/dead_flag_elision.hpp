@@ -13,7 +13,29 @@ namespace lunatic {
 namespace frontend {
 
 struct IRDeadFlagElisionPass final : IRPass {
+  void Run(BasicBlock& basic_block) override;
   void Run(IREmitter& emitter) override;
+
+private:
+  // CPSR flags which are overwritten before they are read.
+  struct Flags {
+    bool n = false;
+    bool z = false;
+    bool c = false;
+    bool v = false;
+  };
+
+  /**
+   * Remove flag updates that are overwritten before they are read.
+   *
+   * @param  emitter         the code to optimize
+   * @param  unused_at_exit  the flags that are overwritten after the code
+   * @returns the flags that are overwritten from the start of the code
+   */
+  auto Elide(IREmitter& emitter, Flags unused_at_exit) -> Flags;
+
+  /// Get the flags that are read to evaluate a condition.
+  static auto GetFlagsRead(Condition condition) -> Flags;
 };
 
 } // namespace lunatic::frontend
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "frontend/basic_block.hpp"
 #include "frontend/ir/emitter.hpp"
 
 namespace lunatic {
@@ -15,27 +16,18 @@ namespace frontend {
 struct IRPass {
   virtual ~IRPass() = default;
 
-  virtual void Run(IREmitter& emitter) = 0;
-
-protected:
-  using InstructionList = IREmitter::InstructionList;
-
-  bool Repoint(
-    IRVariable const& var_old,
-    IRVariable const& var_new,
-    InstructionList::const_iterator begin,
-    InstructionList::const_iterator end
-  ) {
-    if (var_old.data_type != var_new.data_type) {
-      return false;
-    }
-    
-    for (auto it = begin; it != end; ++it) {
-      (*it)->Repoint(var_old, var_new); 
+  /**
+   * Optimize a basic block as a whole.
+   * By default each micro block is optimized on its own.
+   * Passes that look across micro block boundaries override this.
+   */
+  virtual void Run(BasicBlock& basic_block) {
+    for (auto& micro_block : basic_block.micro_blocks) {
+      Run(micro_block.emitter);
     }
+  }
 
-    return true;
-  }  
+  virtual void Run(IREmitter& emitter) = 0;
 };
 
 } // namespace lunatic::frontend
@@ -66,6 +66,10 @@ auto State::GetOffsetToGPR(Mode mode, GPR reg) -> uintptr {
   return uintptr(GetPointerToGPR(mode, reg)) - uintptr(this);
 }
 
+auto State::GetOffsetToCycleCounter() -> uintptr {
+  return uintptr(&cycle_counter) - uintptr(this);
+}
+
 void State::InitializeLookupTable() {
   Mode modes[] = {
     Mode::User,
@@ -44,6 +44,12 @@ struct State {
   /// \returns for a given processor mode the offset of a general-purpose register.
   auto GetOffsetToGPR(Mode mode, GPR reg) -> uintptr;
 
+  /// \returns reference to the number of cycles left before compiled code returns to the dispatcher.
+  auto GetCycleCounter() -> int& { return cycle_counter; }
+
+  /// \returns the offset to the cycle counter.
+  auto GetOffsetToCycleCounter() -> uintptr;
+
 private:
   void InitializeLookupTable();
 
@@ -74,6 +80,9 @@ private:
     u32* gpr[16] {nullptr};
     StatusRegister* spsr {nullptr};
   } table[0x20] = {};
+
+  /// Number of cycles left to run, kept in memory so that the host can stop compiled code at any time.
+  int cycle_counter = 0;
 };
 
 } // namespace lunatic::frontend
@@ -128,6 +128,11 @@ auto Translator::Handle(ARMBlockDataTransfer const& opcode) -> Status {
 
   // Flush the pipeline if we loaded R15.
   if (opcode.load && transfer_pc) {
+    // POP {..., PC} or LDMIA SP!, {..., PC}
+    if (opcode.reg_base == GPR::SP && !opcode.user_mode) {
+      PredictFunctionReturn();
+    }
+
     if (opcode.user_mode) {
       EmitFlush();
     } else if (armv5te) {
@@ -17,6 +17,10 @@ auto Translator::Handle(ARMBranchExchange const& opcode) -> Status {
       link_address |= 1;
     }
     emitter->StoreGPR(IRGuestReg{GPR::LR, mode}, IRConstant{link_address});
+    PredictFunctionCall(link_address);
+  } else if (opcode.reg == GPR::LR) {
+    // BX LR
+    PredictFunctionReturn();
   }
 
   auto& address = emitter->CreateVar(IRDataType::UInt32, "address");
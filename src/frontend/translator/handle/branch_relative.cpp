@@ -20,6 +20,7 @@ auto Translator::Handle(ARMBranchRelative const& opcode) -> Status {
       link_address |= 1;
     }
     emitter->StoreGPR(IRGuestReg{GPR::LR, mode}, IRConstant{link_address});
+    PredictFunctionCall(link_address);
   }
 
   if (opcode.exchange) {
@@ -44,21 +45,38 @@ auto Translator::Handle(ARMBranchRelative const& opcode) -> Status {
 
   emitter->StoreGPR(IRGuestReg{GPR::PC, mode}, IRConstant{branch_address});
 
-  if (!opcode.exchange && opcode.condition == Condition::AL) {
+  // Function calls end the basic block to push the return address onto the return stack buffer.
+  // Loops back to the start of the basic block end it too, instead of being unrolled.
+  if (!opcode.exchange && !opcode.link && opcode.condition == Condition::AL &&
+      branch_address != basic_block->key.Address()) {
     code_address = branch_address - opcode_size * 3;
     basic_block->branch_target.key = {};
     return Status::Continue;
-  } else {
-    if (opcode.exchange) {
-      thumb_mode = !thumb_mode;
-    }
-    basic_block->branch_target.key = BasicBlock::Key{
-      branch_address,
-      mode,
-      thumb_mode
-    };
   }
 
+  /* Form a superblock: continue with the not-taken path
+   * and leave the superblock through a side exit if the branch is taken.
+   * Unconditional branches have no not-taken path, so they end the basic block.
+   */
+  if (!opcode.exchange && !opcode.link && opcode.condition != Condition::AL &&
+      basic_block->length + 1 < max_superblock_size) {
+    auto& side_exit = micro_block->side_exit;
+
+    side_exit.key = BasicBlock::Key{branch_address, mode, thumb_mode};
+    side_exit.length = basic_block->length + 1;
+    instruction_budget = std::max(max_block_size, max_superblock_size);
+    return Status::BreakMicroBlock;
+  }
+
+  if (opcode.exchange) {
+    thumb_mode = !thumb_mode;
+  }
+  basic_block->branch_target.key = BasicBlock::Key{
+    branch_address,
+    mode,
+    thumb_mode
+  };
+
   return Status::BreakBasicBlock;
 }
 
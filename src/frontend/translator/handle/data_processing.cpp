@@ -277,6 +277,15 @@ auto Translator::Handle(ARMDataProcessing const& opcode) -> Status {
     if (opcode.set_flags) {
       EmitFlush();
     } else {
+      // MOV PC, LR
+      if (opcode.opcode == Opcode::MOV &&
+          !opcode.immediate &&
+          opcode.op2_reg.reg == GPR::LR &&
+          opcode.op2_reg.shift.immediate &&
+          opcode.op2_reg.shift.amount_imm == 0 &&
+          opcode.op2_reg.shift.type == Shift::LSL) {
+        PredictFunctionReturn();
+      }
       EmitFlushNoSwitch();
     }
     return Status::BreakBasicBlock;
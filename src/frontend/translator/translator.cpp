@@ -5,15 +5,20 @@
  * found in the LICENSE file.
  */
 
+#include <bitset>
+#include <unordered_map>
+
 #include "translator.hpp"
 
 namespace lunatic {
 namespace frontend {
 
-Translator::Translator(CPU::Descriptor const& descriptor)
+Translator::Translator(CPU::Descriptor const& descriptor, bool direct_fetch_only)
     : armv5te(descriptor.model == CPU::Descriptor::Model::ARM9)
     , max_block_size(descriptor.block_size)
+    , max_superblock_size(descriptor.superblock_size)
     , exception_base(descriptor.exception_base)
+    , direct_fetch_only(direct_fetch_only)
     , memory(descriptor.memory)
     , coprocessors(descriptor.coprocessors) {
 }
@@ -23,6 +28,7 @@ void Translator::Translate(BasicBlock& basic_block) {
   thumb_mode = basic_block.key.Thumb();
   opcode_size = thumb_mode ? sizeof(u16) : sizeof(u32);
   code_address = basic_block.key.Address() - 2 * opcode_size;
+  instruction_budget = max_block_size;
   this->basic_block = &basic_block;
 
   if (thumb_mode) {
@@ -30,6 +36,8 @@ void Translator::Translate(BasicBlock& basic_block) {
   } else {
     TranslateARM(basic_block);
   }
+
+  DetectIdleLoop();
 }
 
 void Translator::TranslateARM(BasicBlock& basic_block) {
@@ -40,7 +48,9 @@ void Translator::TranslateARM(BasicBlock& basic_block) {
   };
 
   auto break_micro_block = [&](Condition condition) {
-    add_micro_block();
+    if (micro_block.length != 0) {
+      add_micro_block();
+    }
     micro_block = {
       .condition = condition
     };
@@ -48,9 +58,14 @@ void Translator::TranslateARM(BasicBlock& basic_block) {
   };
 
   emitter = &micro_block.emitter;
+  this->micro_block = &micro_block;
 
-  for (int i = 0; i < max_block_size; i++) {
-    auto instruction = memory.FastRead<u32, Memory::Bus::Code>(code_address);
+  auto status = Status::Continue;
+
+  for (int i = 0; i < instruction_budget; i++) {
+    auto instruction = FetchARM(code_address);
+    basic_block.AddAddressRange(code_address, sizeof(u32));
+    basic_block.fetches.push_back({code_address, instruction});
     auto condition = bit::get_field<u32, Condition>(instruction, 28, 4);
 
     // ARMv5TE+ treats condition code 'NV' as a separate
@@ -65,7 +80,7 @@ void Translator::TranslateARM(BasicBlock& basic_block) {
       break_micro_block(condition);
     }
 
-    auto status = decode_arm(instruction, *this);
+    status = decode_arm(instruction, *this);
 
     if (status == Status::Unimplemented) {
       throw std::runtime_error(
@@ -88,6 +103,16 @@ void Translator::TranslateARM(BasicBlock& basic_block) {
     code_address += sizeof(u32);
   }
 
+  if (status != Status::BreakBasicBlock) {
+    // Make sure that both paths through the last micro block reach the fall-through exit.
+    if (micro_block.condition != Condition::AL) {
+      break_micro_block(Condition::AL);
+    }
+    SetFallThrough(code_address);
+  } else if (micro_block.condition != Condition::AL) {
+    SetFallThrough(code_address + sizeof(u32));
+  }
+
   add_micro_block();
 }
 
@@ -97,20 +122,20 @@ void Translator::TranslateThumb(BasicBlock& basic_block) {
   };
 
   emitter = &micro_block.emitter;
+  this->micro_block = &micro_block;
 
   auto add_micro_block = [&]() {
     basic_block.micro_blocks.push_back(std::move(micro_block));
   };
 
-  for (int i = 0; i < max_block_size; i++) {
-    u32 instruction;
+  auto status = Status::Continue;
 
-    if (code_address & 2) {
-      instruction  = memory.FastRead<u16, Memory::Bus::Code>(code_address + 0);
-      instruction |= memory.FastRead<u16, Memory::Bus::Code>(code_address + 2) << 16;
-    } else {
-      instruction = memory.FastRead<u32, Memory::Bus::Code>(code_address);
-    }
+  for (int i = 0; i < instruction_budget; i++) {
+    auto instruction = FetchThumb(code_address);
+
+    // Include the second half of a (potential) 32-bit BL instruction.
+    basic_block.AddAddressRange(code_address, sizeof(u32));
+    basic_block.fetches.push_back({code_address, instruction});
 
     // HACK: detect conditional branches and break the micro block early.
     if ((instruction & 0xF000) == 0xD000 && (instruction & 0xF00) != 0xF00) {
@@ -127,7 +152,7 @@ void Translator::TranslateThumb(BasicBlock& basic_block) {
       }
     }
 
-    auto status = decode_thumb(instruction, *this);
+    status = decode_thumb(instruction, *this);
 
     if (status == Status::Unimplemented) {
       throw std::runtime_error(
@@ -143,12 +168,69 @@ void Translator::TranslateThumb(BasicBlock& basic_block) {
       break;
     }
 
+    // Continue with an unconditional micro block after a side exit.
+    if (status == Status::BreakMicroBlock) {
+      add_micro_block();
+      micro_block = {
+        .condition = Condition::AL
+      };
+      emitter = &micro_block.emitter;
+    }
+
     code_address += sizeof(u16);
   }
 
+  if (status != Status::BreakBasicBlock) {
+    // Make sure that both paths through the last micro block reach the fall-through exit.
+    if (micro_block.condition != Condition::AL) {
+      add_micro_block();
+      micro_block = {
+        .condition = Condition::AL
+      };
+      emitter = &micro_block.emitter;
+    }
+    SetFallThrough(code_address);
+  } else if (micro_block.condition != Condition::AL) {
+    SetFallThrough(code_address + sizeof(u16));
+  }
+
   add_micro_block();
 }
 
+bool Translator::Verify(BasicBlock const& basic_block) {
+  auto key = basic_block.key;
+
+  for (auto const& fetch : basic_block.fetches) {
+    auto opcode = key.Thumb() ? FetchThumb(fetch.address) : FetchARM(fetch.address);
+
+    if (opcode != fetch.opcode) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+auto Translator::FetchARM(u32 address) -> u32 {
+  if (direct_fetch_only && !IsRAM(address, Memory::Bus::Code)) {
+    throw IndirectFetch{};
+  }
+  return memory.FastRead<u32, Memory::Bus::Code>(address);
+}
+
+auto Translator::FetchThumb(u32 address) -> u32 {
+  if (direct_fetch_only && !(IsRAM(address, Memory::Bus::Code) && IsRAM(address + 2, Memory::Bus::Code))) {
+    throw IndirectFetch{};
+  }
+
+  // Read two opcodes, so that both halves of a 32-bit BL instruction are available.
+  if (address & 2) {
+    return memory.FastRead<u16, Memory::Bus::Code>(address + 0) |
+          (memory.FastRead<u16, Memory::Bus::Code>(address + 2) << 16);
+  }
+  return memory.FastRead<u32, Memory::Bus::Code>(address);
+}
+
 auto Translator::Undefined(u32 opcode) -> Status {
   return Status::Unimplemented;
 }
@@ -230,5 +312,190 @@ void Translator::EmitLoadSPSRToCPSR() {
   emitter->StoreCPSR(spsr);
 }
 
+void Translator::PredictFunctionCall(u32 return_address) {
+  basic_block->return_stack.push_key = BasicBlock::Key{
+    (return_address & ~1) + opcode_size * 2,
+    mode,
+    thumb_mode
+  };
+}
+
+void Translator::PredictFunctionReturn() {
+  basic_block->return_stack.pop = true;
+}
+
+void Translator::SetFallThrough(u32 address) {
+  auto& key = basic_block->key;
+
+  basic_block->fall_through.key = BasicBlock::Key{address + opcode_size * 2, key.Mode(), key.Thumb()};
+  basic_block->fall_through.length = basic_block->length;
+}
+
+void Translator::DetectIdleLoop() {
+  auto& micro_blocks = basic_block->micro_blocks;
+  auto key = basic_block->key.value;
+  auto loop_length = size_t(0);
+  bool* idle_loop = nullptr;
+
+  // Find the first exit which goes back to the start of the basic block.
+  for (size_t i = 0; i < micro_blocks.size(); i++) {
+    auto& side_exit = micro_blocks[i].side_exit;
+
+    if (side_exit.key.value == key) {
+      idle_loop = &side_exit.idle_loop;
+      loop_length = i + 1;
+      break;
+    }
+  }
+
+  if (idle_loop == nullptr) {
+    auto& branch_target = basic_block->branch_target;
+
+    if (branch_target.key.value != key || basic_block->return_stack.push_key.value != 0) {
+      return;
+    }
+    idle_loop = &branch_target.idle_loop;
+    loop_length = micro_blocks.size();
+  }
+
+  auto const pc_id = static_cast<int>(GPR::PC);
+  auto stored = std::bitset<512>{};
+  auto written = std::bitset<512>{};
+
+  // Variables which hold a value that is known at compile time.
+  auto constants = std::unordered_map<IRVariable const*, u32>{};
+
+  auto get_const = [&](IRAnyRef const& value) -> Optional<u32> {
+    if (value.IsConstant()) {
+      return value.GetConst().value;
+    }
+    if (value.IsVariable()) {
+      auto match = constants.find(&value.GetVar());
+      if (match != constants.end()) {
+        return match->second;
+      }
+    }
+    return {};
+  };
+
+  auto fold_binary_op = [&](auto binary_op, auto fn) {
+    auto lhs = get_const(binary_op->lhs.Get());
+    auto rhs = get_const(binary_op->rhs);
+
+    if (binary_op->result.HasValue() && lhs.HasValue() && rhs.HasValue()) {
+      constants[&binary_op->result.Unwrap()] = fn(lhs.Unwrap(), rhs.Unwrap());
+    }
+  };
+
+  // Only allow opcodes which do not have side effects and do not read the carry flag.
+  for (size_t i = 0; i < loop_length; i++) {
+    for (auto const& op : micro_blocks[i].emitter.Code()) {
+      switch (op->GetClass()) {
+        case IROpcodeClass::StoreGPR: {
+          stored.set(lunatic_cast<IRStoreGPR>(op)->reg.ID());
+          break;
+        }
+        case IROpcodeClass::MOV: {
+          auto mov_op = lunatic_cast<IRMov>(op);
+          auto value = get_const(mov_op->source);
+
+          if (value.HasValue()) {
+            constants[&mov_op->result.Get()] = value.Unwrap();
+          }
+          break;
+        }
+        case IROpcodeClass::ADD: {
+          fold_binary_op(lunatic_cast<IRAdd>(op), [](u32 lhs, u32 rhs) { return lhs + rhs; });
+          break;
+        }
+        case IROpcodeClass::SUB: {
+          fold_binary_op(lunatic_cast<IRSub>(op), [](u32 lhs, u32 rhs) { return lhs - rhs; });
+          break;
+        }
+        case IROpcodeClass::MemoryRead: {
+          auto read_op = lunatic_cast<IRMemoryRead>(op);
+          auto address = get_const(read_op->address.Get());
+
+          /* Reads from I/O registers may have side effects or return a value which
+           * only changes while the host runs, so only allow reads from plain memory.
+           */
+          if (address.IsNull() || !IsRAM(address.Unwrap(), Memory::Bus::Data)) {
+            return;
+          }
+
+          // Literal pools in read-only memory provide the address of the polled variable.
+          auto page_index = address.Unwrap() >> Memory::kPageShift;
+
+          if ((read_op->flags & Word) && memory.read_only_pages &&
+              ((*memory.read_only_pages)[page_index >> 5] & (1U << (page_index & 31))) != 0) {
+            constants[&read_op->result.Get()] = memory.FastRead<u32, Memory::Bus::Data>(address.Unwrap());
+          }
+          break;
+        }
+        case IROpcodeClass::LoadGPR:
+        case IROpcodeClass::LoadCPSR:
+        case IROpcodeClass::StoreCPSR:
+        case IROpcodeClass::ClearCarry:
+        case IROpcodeClass::SetCarry:
+        case IROpcodeClass::UpdateFlags:
+        case IROpcodeClass::LSL:
+        case IROpcodeClass::LSR:
+        case IROpcodeClass::ASR:
+        case IROpcodeClass::AND:
+        case IROpcodeClass::BIC:
+        case IROpcodeClass::EOR:
+        case IROpcodeClass::RSB:
+        case IROpcodeClass::ORR:
+        case IROpcodeClass::MVN:
+        case IROpcodeClass::MUL:
+        case IROpcodeClass::CLZ: {
+          break;
+        }
+        default: {
+          return;
+        }
+      }
+    }
+  }
+
+  /* Each iteration must compute the same result from the same memory contents.
+   * So any register the loop modifies (except the PC) must be written before it is read.
+   */
+  for (size_t i = 0; i < loop_length; i++) {
+    auto& micro_block = micro_blocks[i];
+
+    for (auto const& op : micro_block.emitter.Code()) {
+      if (op->GetClass() == IROpcodeClass::LoadGPR) {
+        auto id = lunatic_cast<IRLoadGPR>(op)->reg.ID();
+
+        if (id != pc_id && stored[id] && !written[id]) {
+          return;
+        }
+      }
+
+      // Writes in conditional micro blocks may not happen.
+      if (op->GetClass() == IROpcodeClass::StoreGPR && micro_block.condition == Condition::AL) {
+        written.set(lunatic_cast<IRStoreGPR>(op)->reg.ID());
+      }
+    }
+  }
+
+  *idle_loop = true;
+}
+
+bool Translator::IsRAM(u32 address, Memory::Bus bus) {
+  // The TCMs take priority over the page table. The DTCM is not accessible via the code bus.
+  if (memory.itcm.config.enable_read && address >= memory.itcm.config.base && address <= memory.itcm.config.limit) {
+    return true;
+  }
+
+  if (bus == Memory::Bus::Data && memory.dtcm.config.enable_read &&
+      address >= memory.dtcm.config.base && address <= memory.dtcm.config.limit) {
+    return true;
+  }
+
+  return memory.pagetable && (*memory.pagetable)[address >> Memory::kPageShift] != nullptr;
+}
+
 } // namespace lunatic::frontend
 } // namespace lunatic
@@ -25,10 +25,27 @@ enum class Status {
 };
 
 struct Translator final : ARMDecodeClient<Status> {
-  Translator(CPU::Descriptor const& descriptor);
+  /**
+   * Thrown by Translate() if the code cannot be fetched without calling into the Memory interface,
+   * while the translator is restricted to direct fetches.
+   */
+  struct IndirectFetch {};
+
+  /**
+   * @param  descriptor          the CPU configuration
+   * @param  direct_fetch_only   only fetch code from the ITCM or from pages in the page table,
+   *                             so that the translator never calls into the Memory interface.
+   */
+  Translator(CPU::Descriptor const& descriptor, bool direct_fetch_only = false);
 
   void Translate(BasicBlock& basic_block);
 
+  /**
+   * Check that guest memory still holds the opcodes that a basic block was translated from.
+   * Does not modify the state of the translator, so it may be called from any thread.
+   */
+  bool Verify(BasicBlock const& basic_block);
+
   auto Handle(ARMDataProcessing const& opcode) -> Status override;
   auto Handle(ARMMoveStatusRegister const& opcode) -> Status override;
   auto Handle(ARMMoveRegisterStatus const& opcode) -> Status override;
@@ -54,6 +71,9 @@ private:
   void TranslateARM(BasicBlock& basic_block);
   void TranslateThumb(BasicBlock& basic_block);
 
+  auto FetchARM(u32 address) -> u32;
+  auto FetchThumb(u32 address) -> u32;
+
   void EmitUpdateNZ();
   void EmitUpdateNZC();
   void EmitUpdateNZCV();
@@ -63,6 +83,11 @@ private:
   void EmitFlushExchange(IRVariable const& address);
   void EmitFlushNoSwitch();
   void EmitLoadSPSRToCPSR();
+  void PredictFunctionCall(u32 return_address);
+  void PredictFunctionReturn();
+  void DetectIdleLoop();
+  bool IsRAM(u32 address, Memory::Bus bus);
+  void SetFallThrough(u32 address);
 
   // TODO: deduce opcode_size from thumb_mode. this is redundant.
   u32 code_address;
@@ -71,10 +96,14 @@ private:
   Mode mode;
   bool armv5te;
   int  max_block_size;
+  int  max_superblock_size;
+  int  instruction_budget;
   u32  exception_base;
+  bool direct_fetch_only;
   Memory& memory;
   std::array<Coprocessor*, 16> coprocessors;
   IREmitter* emitter = nullptr;
+  BasicBlock::MicroBlock* micro_block = nullptr;
   BasicBlock* basic_block = nullptr;
 };
 
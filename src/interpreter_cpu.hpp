@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2021 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include "frontend/interpreter/interpreter.hpp"
+#include "cpu_base.hpp"
+
+namespace lunatic {
+
+/**
+ * Runs guest code in the interpreter only, without generating any host code.
+ * Useful for code which runs only once and to tell apart bugs in the JIT from bugs in the guest.
+ */
+struct InterpreterCPU final : CPUBase {
+  InterpreterCPU(CPU::Descriptor const& descriptor)
+      : CPUBase(descriptor)
+      , interpreter(descriptor, state) {
+  }
+
+  // The interpreter compares each cached instruction to guest memory before running it.
+  void ClearICache() override {}
+  void ClearICacheRange(u32 address_lo, u32 address_hi) override {}
+
+protected:
+  auto Dispatch(int cycles) -> int override {
+    return interpreter.Run(cycles);
+  }
+
+private:
+  frontend::Interpreter interpreter;
+};
+
+} // namespace lunatic
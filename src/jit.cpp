@@ -2,14 +2,28 @@
  * Copyright (C) 2021 fleroviux
  */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <lunatic/cpu.hpp>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
+#include "common/spsc_queue.hpp"
+#include "cpu_base.hpp"
+#include "frontend/interpreter/interpreter.hpp"
+#include "frontend/ir_opt/constant_propagation.hpp"
 #include "frontend/ir_opt/context_load_store_elision.hpp"
 #include "frontend/ir_opt/dead_code_elision.hpp"
 #include "frontend/ir_opt/dead_flag_elision.hpp"
 #include "frontend/state.hpp"
 #include "frontend/translator/translator.hpp"
+#include "interpreter_cpu.hpp"
 #include "backend/x86_64/backend.hpp"
 
 using namespace lunatic::frontend;
@@ -17,32 +31,53 @@ using namespace lunatic::backend;
 
 namespace lunatic {
 
-struct JIT final : CPU {
+struct JIT final : CPUBase {
   JIT(CPU::Descriptor const& descriptor)
-      : exception_base(descriptor.exception_base)
+      : CPUBase(descriptor)
+      , hotness_threshold(descriptor.hotness_threshold)
+      , interpreter_threshold(descriptor.interpreter_threshold)
+      , background_compilation(descriptor.background_compilation)
       , memory(descriptor.memory)
+      , interpreter(descriptor, state)
       , translator(descriptor)
-      , backend(descriptor, state, block_cache, irq_line) {
+      , worker_translator(descriptor, true)
+      , block_cache(memory)
+      , backend(descriptor, state, block_cache) {
     passes.push_back(std::make_unique<IRContextLoadStoreElisionPass>());
+    passes.push_back(std::make_unique<IRConstantPropagationPass>(memory));
     passes.push_back(std::make_unique<IRDeadFlagElisionPass>());
     passes.push_back(std::make_unique<IRDeadCodeElisionPass>());
-  }
 
-  void Reset() override {
-    irq_line = false;
-    wait_for_irq = false;
-    cycles_to_run = 0;
-    state.Reset();
-    SetGPR(GPR::PC, exception_base);
-    block_cache.Flush();
+    memory.code_pages = block_cache.code_pages->data();
+    memory.code_write_handler = [this](u32 address, u32 size) {
+      block_cache.FlushWrite(address, size);
+    };
+
+    if (background_compilation) {
+      worker = std::thread{[this]() { RunWorker(); }};
+    }
   }
 
-  auto IRQLine() -> bool& override {
-    return irq_line;
+ ~JIT() override {
+    if (background_compilation) {
+      worker_stop = true;
+      worker_cv.notify_one();
+      worker.join();
+
+      auto result = CompileResult{};
+      while (compile_results.Pop(result)) {
+        delete result.basic_block;
+      }
+    }
+
+    memory.code_pages = nullptr;
+    memory.code_write_handler = nullptr;
   }
 
-  auto WaitForIRQ() -> bool& override {
-    return wait_for_irq;
+  void Reset() override {
+    CPUBase::Reset();
+    block_cache.Flush();
+    cold_counters.fill(0);
   }
 
   void ClearICache() override {
@@ -53,164 +88,257 @@ struct JIT final : CPU {
     block_cache.Flush(address_lo, address_hi);
   }
 
-  auto Run(int cycles) -> int override {
-    if (WaitForIRQ() && !IRQLine()) {
-      return 0;
-    }
+protected:
+  auto Dispatch(int cycles) -> int override {
+    block_cache.DeleteReleasedBlocks();
 
-    cycles_to_run += cycles;
+    if (background_compilation) {
+      PublishCompiledBlocks();
+    }
 
-    int cycles_available = cycles_to_run;
+    auto block_key = BasicBlock::Key{state};
+    auto basic_block = block_cache.Get(block_key);
 
-    while (cycles_to_run > 0) {
-      if (IRQLine()) {
-        SignalIRQ();
+    if (basic_block == nullptr) {
+      // Interpret code that did not run often enough yet to be worth compiling.
+      if (IsCold(block_key)) {
+        return interpreter.Run(cycles);
       }
 
-      auto block_key = BasicBlock::Key{state};
-      auto basic_block = block_cache.Get(block_key);
-      auto hash = GetBasicBlockHash(block_key);
+      if (background_compilation) {
+        RequestCompile(block_key, 0, 0);
+        return interpreter.Run(cycles);
+      }
 
-      if (basic_block == nullptr || basic_block->hash != hash) {
-        basic_block = Compile(block_key, 0);
+      basic_block = Compile(block_key, 0);
+    } else if (basic_block->tier == 0 && basic_block->hotness_counter == 0) {
+      if (background_compilation) {
+        // Keep running the baseline tier until the optimized version is ready.
+        RequestCompile(block_key, 0, 1);
+      } else {
+        basic_block = Compile(block_key, 0, 1);
       }
+    }
+
+    return backend.Call(*basic_block, cycles);
+  }
 
-      cycles_to_run = backend.Call(*basic_block, cycles_to_run);
+private:
+  struct CompileRequest {
+    BasicBlock::Key key;
+    int depth = 0;
+    int tier = 0;
+  };
+
+  struct CompileResult {
+    CompileRequest request;
+    BasicBlock* basic_block = nullptr;
+    std::exception_ptr exception;
+
+    // Whether the code must be translated on the emulation thread, because the Memory interface would be called.
+    bool indirect_fetch = false;
+  };
 
-      if (WaitForIRQ()) {
-        int cycles_executed = cycles_available - cycles_to_run;
-        cycles_to_run = 0;
-        return cycles_executed;
+  auto Compile(BasicBlock::Key block_key, int depth, int tier = 0) -> BasicBlock* {
+    auto basic_block = Translate(translator, block_key, tier);
+
+    if (depth <= 8) {
+      auto branch_target_key = basic_block->branch_target.key;
+      if (branch_target_key.value != 0 && branch_target_key.value != block_key.value &&
+          !block_cache.Get(branch_target_key)) {
+        Compile(branch_target_key, ++depth);
       }
     }
 
-    return cycles_available - cycles_to_run;
+    return Publish(basic_block);
   }
 
-  auto GetGPR(GPR reg) const -> u32 override {
-    return GetGPR(reg, GetCPSR().f.mode);
-  }
+  auto Translate(Translator& translator, BasicBlock::Key block_key, int tier) -> BasicBlock* {
+    auto basic_block = std::make_unique<BasicBlock>(block_key);
 
-  auto GetGPR(GPR reg, Mode mode) const -> u32 override {
-    return const_cast<JIT*>(this)->GetGPR(reg, mode);
-  }
+    // Skip the baseline tier if tiered compilation is disabled.
+    if (hotness_threshold <= 0) {
+      tier = 1;
+    }
 
-  auto GetCPSR() const -> StatusRegister override {
-    return const_cast<JIT*>(this)->GetCPSR();
-  }
+    basic_block->tier = tier;
+    basic_block->hotness_counter = u32(std::max(hotness_threshold, 0));
+
+    translator.Translate(*basic_block);
+
+    if (tier != 0) {
+      Optimize(basic_block.get());
+    }
 
-  auto GetSPSR(Mode mode) const -> StatusRegister override {
-    return const_cast<JIT*>(this)->GetSPSR(mode);
+    return basic_block.release();
   }
 
-  void SetGPR(GPR reg, u32 value) override {
-    SetGPR(reg, state.GetCPSR().f.mode, value);
+  auto Publish(BasicBlock* basic_block) -> BasicBlock* {
+    // This releases the baseline tier version of the basic block, if there is one.
+    backend.Compile(*basic_block);
+    block_cache.Set(basic_block->key, basic_block);
+    basic_block->micro_blocks.clear();
+    basic_block->fetches = {};
+    return basic_block;
   }
 
-  void SetGPR(GPR reg, Mode mode, u32 value) override {
-    state.GetGPR(mode, reg) = value;
+  /* Queue a basic block for translation on the worker thread, unless it is queued already.
+   * If the queue is full the request is dropped, it will be repeated on the next cache miss
+   * or, for a basic block in the baseline tier, once its hotness counter runs out again.
+   */
+  void RequestCompile(BasicBlock::Key block_key, int depth, int tier) {
+    if (compile_pending.count(block_key.value) != 0) {
+      return;
+    }
 
-    if (reg == GPR::PC) {
-      if (GetCPSR().f.thumb) {
-        state.GetGPR(mode, GPR::PC) += sizeof(u16) * 2;
-      } else {
-        state.GetGPR(mode, GPR::PC) += sizeof(u32) * 2;
+    if (compile_requests.Push({block_key, depth, tier})) {
+      compile_pending.insert(block_key.value);
+      worker_cv.notify_one();
+      return;
+    }
+
+    // The baseline tier never misses the cache, so let it ask again soon.
+    if (tier != 0) {
+      auto basic_block = block_cache.Get(block_key);
+
+      if (basic_block != nullptr && basic_block->tier == 0) {
+        basic_block->hotness_counter = kCompileRetryInterval;
       }
     }
   }
 
-  void SetCPSR(StatusRegister value) override {
-    state.GetCPSR() = value;
-  }
+  /* Generate host code for the basic blocks that the worker thread has translated.
+   * Code generation stays on the emulation thread, which owns the code buffer and the block links.
+   */
+  void PublishCompiledBlocks() {
+    auto result = CompileResult{};
 
-  void SetSPSR(Mode mode, StatusRegister value) override {
-    *state.GetPointerToSPSR(mode) = value;
-  }
+    while (compile_results.Pop(result)) {
+      auto& request = result.request;
 
-private:
-  auto Compile(BasicBlock::Key block_key, int depth) -> BasicBlock* {
-    auto basic_block = new BasicBlock{block_key};
+      compile_pending.erase(request.key.value);
 
-    translator.Translate(*basic_block);
-    Optimize(basic_block);
+      if (result.exception) {
+        std::rethrow_exception(result.exception);
+      }
 
-    basic_block->hash = GetBasicBlockHash(block_key);
+      if (result.indirect_fetch) {
+        Compile(request.key, request.depth, request.tier);
+        continue;
+      }
 
-    if (depth <= 8) {
-      auto branch_target_key = basic_block->branch_target.key;
-      if (branch_target_key.value != 0 && !block_cache.Get(branch_target_key)) {
-        Compile(branch_target_key, ++depth);
+      auto basic_block = result.basic_block;
+
+      // Discard the translation if the guest modified the code in the meantime.
+      if (!translator.Verify(*basic_block)) {
+        delete basic_block;
+        RequestCompile(request.key, request.depth, request.tier);
+        continue;
       }
-    }
 
-    backend.Compile(*basic_block);
-    block_cache.Set(block_key, basic_block);
-    basic_block->micro_blocks.clear();
-    return basic_block;
-  }
+      Publish(basic_block);
 
-  void Optimize(BasicBlock* basic_block) {
-    for (auto &micro_block : basic_block->micro_blocks) {
-      for (auto& pass : passes) {
-        pass->Run(micro_block.emitter);
+      // Translate the likely successor ahead of time, like Compile() does.
+      if (request.depth <= 8) {
+        auto branch_target_key = basic_block->branch_target.key;
+        if (branch_target_key.value != 0 && branch_target_key.value != request.key.value &&
+            !block_cache.Get(branch_target_key)) {
+          RequestCompile(branch_target_key, request.depth + 1, 0);
+        }
       }
     }
   }
 
-  void SignalIRQ() {
-    auto& cpsr = GetCPSR();
+  void RunWorker() {
+    while (!worker_stop) {
+      auto request = CompileRequest{};
 
-    wait_for_irq = false;
+      if (!compile_requests.Pop(request)) {
+        auto lock = std::unique_lock{worker_mutex};
 
-    if (!cpsr.f.mask_irq) {
-      GetSPSR(Mode::IRQ) = cpsr;
+        // Requests are queued without taking the lock, so a notification may be missed.
+        worker_cv.wait_for(lock, std::chrono::milliseconds{1});
+        continue;
+      }
 
-      cpsr.f.mode = Mode::IRQ;
-      cpsr.f.mask_irq = 1;
-      if (cpsr.f.thumb) {
-        GetGPR(GPR::LR) = GetGPR(GPR::PC);
-      } else {
-        GetGPR(GPR::LR) = GetGPR(GPR::PC) - 4;
+      auto result = CompileResult{request};
+
+      try {
+        result.basic_block = Translate(worker_translator, request.key, request.tier);
+      } catch (Translator::IndirectFetch const&) {
+        result.indirect_fetch = true;
+      } catch (...) {
+        result.exception = std::current_exception();
       }
-      cpsr.f.thumb = 0;
 
-      GetGPR(GPR::PC) = exception_base + 0x18 + sizeof(u32) * 2;
+      while (!compile_results.Push(result)) {
+        if (worker_stop) {
+          delete result.basic_block;
+          return;
+        }
+        std::this_thread::yield();
+      }
     }
   }
 
-  auto GetBasicBlockHash(BasicBlock::Key block_key) -> u32 {
-    return memory.FastRead<u32, Memory::Bus::Code>(block_key.Address());
+  // Passes see the whole basic block, so that they can optimize across micro block boundaries.
+  void Optimize(BasicBlock* basic_block) {
+    for (auto& pass : passes) {
+      pass->Run(*basic_block);
+    }
   }
 
-  auto GetGPR(GPR reg) -> u32& {
-    return GetGPR(reg, GetCPSR().f.mode);
-  }
+  /* Count how often the dispatcher reached a basic block which is not compiled.
+   * The basic block is interpreted until the count reaches interpreter_threshold.
+   * Basic blocks may share a counter, which only makes them get compiled earlier.
+   */
+  bool IsCold(BasicBlock::Key block_key) {
+    if (interpreter_threshold <= 0) {
+      return false;
+    }
 
-  auto GetGPR(GPR reg, Mode mode) -> u32& {
-    return state.GetGPR(mode, reg);
-  }
+    auto& counter = cold_counters[(block_key.value * 0x9E3779B97F4A7C15ULL) >> (64 - kColdCounterBits)];
 
-  auto GetCPSR() -> StatusRegister& {
-    return state.GetCPSR();
-  }
+    if (counter < interpreter_threshold) {
+      counter++;
+      return true;
+    }
 
-  auto GetSPSR(Mode mode) -> StatusRegister& {
-    return *state.GetPointerToSPSR(mode);
+    return false;
   }
 
-  bool irq_line = false;
-  bool wait_for_irq = false;
-  int cycles_to_run = 0;
-  u32 exception_base;
+  static constexpr int kColdCounterBits = 12;
+
+  // Number of executions after which a dropped request to optimize a basic block is repeated.
+  static constexpr u32 kCompileRetryInterval = 16;
+
+  int hotness_threshold;
+  int interpreter_threshold;
+  bool background_compilation;
   Memory& memory;
-  State state;
+  Interpreter interpreter;
   Translator translator;
+  Translator worker_translator;
   BasicBlockCache block_cache;
   X64Backend backend;
   std::vector<std::unique_ptr<IRPass>> passes;
+
+  // Background compilation (only the worker thread translates and optimizes in this mode)
+  std::thread worker;
+  std::atomic<bool> worker_stop = false;
+  std::mutex worker_mutex;
+  std::condition_variable worker_cv;
+  SPSCQueue<CompileRequest, 64> compile_requests;
+  SPSCQueue<CompileResult, 64> compile_results;
+  std::unordered_set<u64> compile_pending;
+
+  std::array<int, 1 << kColdCounterBits> cold_counters{};
 };
 
 auto CreateCPU(CPU::Descriptor const& descriptor) -> std::unique_ptr<CPU> {
+  if (descriptor.engine == CPU::Descriptor::Engine::Interpreter) {
+    return std::make_unique<InterpreterCPU>(descriptor);
+  }
   return std::make_unique<JIT>(descriptor);
 }
 
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <vector>
+
+#include "frontend/basic_block_cache.hpp"
+#include "test_common.hpp"
+
+using namespace lunatic;
+using namespace lunatic::frontend;
+
+// Find keys whose ideal slot in a table of the initial capacity is the given slot.
+static auto FindKeysForSlot(size_t slot, int count) -> std::vector<BasicBlock::Key> {
+  auto keys = std::vector<BasicBlock::Key>{};
+  auto mask = BasicBlockCache::kInitialCapacity - 1;
+
+  for (u32 address = 0; keys.size() < size_t(count); address += sizeof(u32)) {
+    auto key = BasicBlock::Key{address, Mode::System, false};
+
+    if ((BasicBlockCache::Hash(key.value) & mask) == slot) {
+      keys.push_back(key);
+    }
+  }
+
+  return keys;
+}
+
+// Each entry must be reachable from its ideal slot without crossing an empty slot.
+static bool IsConsistent(BasicBlockCache const& block_cache) {
+  auto capacity = size_t(block_cache.mask + 1);
+  auto size = size_t(0);
+
+  for (size_t slot = 0; slot < capacity; slot++) {
+    auto key = block_cache.entries[slot].key;
+
+    if (key != 0) {
+      for (auto probe = BasicBlockCache::Hash(key) & block_cache.mask; probe != slot; probe = (probe + 1) & block_cache.mask) {
+        if (block_cache.entries[probe].key == 0) {
+          return false;
+        }
+      }
+
+      if (block_cache.basic_blocks[slot] == nullptr || block_cache.basic_blocks[slot]->key.value != key) {
+        return false;
+      }
+      size++;
+    }
+  }
+
+  return size == block_cache.size;
+}
+
+static bool ContainsAll(BasicBlockCache const& block_cache, std::vector<BasicBlock::Key> const& keys) {
+  for (auto key : keys) {
+    auto basic_block = block_cache.Get(key);
+
+    if (basic_block == nullptr || basic_block->key.value != key.value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Removing an entry must move back the entries after it, even if they wrapped around to the start of the table.
+static void TestRemoveAtWrapAround() {
+  auto test = "TestRemoveAtWrapAround";
+  auto memory = TestMemory{};
+  auto block_cache = BasicBlockCache{memory};
+  auto keys = FindKeysForSlot(BasicBlockCache::kInitialCapacity - 1, 3);
+  auto key_for_slot_0 = FindKeysForSlot(0, 1)[0];
+
+  // The keys occupy the last slot and the first two slots, the key for slot zero ends up in slot two.
+  for (auto key : keys) {
+    block_cache.Set(key, new BasicBlock{key});
+  }
+  block_cache.Set(key_for_slot_0, new BasicBlock{key_for_slot_0});
+
+  Expect(block_cache.entries[2].key == key_for_slot_0.value, test, "key must be probed past the wrapped around keys");
+
+  auto removed_key = keys[0];
+
+  block_cache.Set(removed_key, nullptr);
+  keys.erase(keys.begin());
+  keys.push_back(key_for_slot_0);
+
+  Expect(block_cache.Get(removed_key) == nullptr, test, "removed key must not be found");
+  Expect(ContainsAll(block_cache, keys), test, "remaining keys must be found");
+  Expect(IsConsistent(block_cache), test, "table must be consistent");
+  Expect(block_cache.entries[BasicBlockCache::kInitialCapacity - 1].key == keys[0].value, test, "wrapped around key must move back to its ideal slot");
+  Expect(block_cache.entries[0].key == keys[1].value, test, "wrapped around key must move back");
+  Expect(block_cache.entries[1].key == key_for_slot_0.value, test, "key must move back, but not before its ideal slot");
+  Expect(block_cache.entries[2].key == 0, test, "last slot of the chain must be empty");
+}
+
+// Removing an entry from the middle of a collision chain must keep the rest of the chain and the entries after it reachable.
+static void TestRemoveFromCollisionChain() {
+  auto test = "TestRemoveFromCollisionChain";
+  auto memory = TestMemory{};
+  auto block_cache = BasicBlockCache{memory};
+  auto keys = FindKeysForSlot(100, 4);
+  auto key_for_slot_101 = FindKeysForSlot(101, 1)[0];
+  auto key_for_slot_106 = FindKeysForSlot(106, 1)[0];
+
+  for (auto key : keys) {
+    block_cache.Set(key, new BasicBlock{key});
+  }
+  block_cache.Set(key_for_slot_101, new BasicBlock{key_for_slot_101});
+  block_cache.Set(key_for_slot_106, new BasicBlock{key_for_slot_106});
+
+  auto removed_key = keys[1];
+
+  block_cache.Set(removed_key, nullptr);
+  keys.erase(keys.begin() + 1);
+  keys.push_back(key_for_slot_101);
+  keys.push_back(key_for_slot_106);
+
+  Expect(block_cache.Get(removed_key) == nullptr, test, "removed key must not be found");
+  Expect(ContainsAll(block_cache, keys), test, "remaining keys must be found");
+  Expect(IsConsistent(block_cache), test, "table must be consistent");
+  Expect(block_cache.entries[106].key == key_for_slot_106.value, test, "key in its ideal slot must not move");
+
+  // Re-inserting the key must reuse the table without duplicates.
+  block_cache.Set(removed_key, new BasicBlock{removed_key});
+  keys.push_back(removed_key);
+
+  Expect(ContainsAll(block_cache, keys), test, "re-inserted key must be found");
+  Expect(IsConsistent(block_cache) && block_cache.size == keys.size(), test, "table must be consistent after re-inserting");
+}
+
+// The table must grow before it is half full and keep all entries.
+static void TestGrow() {
+  auto test = "TestGrow";
+  auto memory = TestMemory{};
+  auto block_cache = BasicBlockCache{memory};
+  auto keys = std::vector<BasicBlock::Key>{};
+
+  for (u32 i = 0; i < BasicBlockCache::kInitialCapacity; i++) {
+    auto key = BasicBlock::Key{i * 4, Mode::System, false};
+
+    block_cache.Set(key, new BasicBlock{key});
+    keys.push_back(key);
+  }
+
+  auto statistics = block_cache.GetStatistics();
+
+  Expect(statistics.capacity >= BasicBlockCache::kInitialCapacity * 2, test, "table must grow");
+  Expect(statistics.size == keys.size(), test, "size must match the number of keys");
+  Expect(ContainsAll(block_cache, keys), test, "keys must be found after growing");
+  Expect(IsConsistent(block_cache), test, "table must be consistent after growing");
+
+  // Remove every other key, which moves entries of the grown table.
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    block_cache.Set(keys[i], nullptr);
+  }
+
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    Expect(block_cache.Get(keys[i]) == nullptr, test, "removed keys must not be found");
+  }
+  for (size_t i = 1; i < keys.size(); i += 2) {
+    Expect(block_cache.Get(keys[i]) != nullptr, test, "remaining keys must be found");
+  }
+  Expect(IsConsistent(block_cache), test, "table must be consistent after removing");
+}
+
+// The statistics sum up the inline caches of all basic blocks.
+static void TestInlineCacheStatistics() {
+  auto test = "TestInlineCacheStatistics";
+  auto memory = TestMemory{};
+  auto block_cache = BasicBlockCache{memory};
+
+  for (u32 i = 0; i < 3; i++) {
+    auto key = BasicBlock::Key{i * 4, Mode::System, false};
+    auto basic_block = new BasicBlock{key};
+
+    basic_block->inline_cache.hits = 10 * (i + 1);
+    basic_block->inline_cache.misses = i + 1;
+    basic_block->inline_cache.megamorphic = i == 2;
+    block_cache.Set(key, basic_block);
+  }
+
+  auto statistics = block_cache.GetStatistics();
+
+  Expect(statistics.inline_cache_hits == 60, test, "hits must be summed up");
+  Expect(statistics.inline_cache_misses == 6, test, "misses must be summed up");
+  Expect(statistics.megamorphic_branches == 1, test, "megamorphic branches must be counted");
+}
+
+// A write through a mirror of the memory that code was translated from must invalidate the code.
+static void TestWriteToPageTableMirror() {
+  auto test = "TestWriteToPageTableMirror";
+  auto memory = TestMemory{};
+  u8 data[1 << Memory::kPageShift];
+
+  memory.pagetable = std::make_unique<std::array<u8*, 1048576>>();
+  (*memory.pagetable)[0] = data;
+  (*memory.pagetable)[1] = data;
+
+  auto block_cache = BasicBlockCache{memory};
+  auto key = BasicBlock::Key{8, Mode::System, false};
+  auto basic_block = new BasicBlock{key};
+
+  basic_block->AddAddressRange(0x100, sizeof(u32));
+  block_cache.Set(key, basic_block);
+
+  Expect((*block_cache.code_pages)[1] != 0 && (*block_cache.code_pages)[1] == (*block_cache.code_pages)[0], test, "mirror must be marked as containing code");
+
+  block_cache.FlushWrite(0x1100, sizeof(u32));
+
+  Expect(block_cache.Get(key) == nullptr, test, "write to the mirror must invalidate the basic block");
+  Expect((*block_cache.code_pages)[0] == 0 && (*block_cache.code_pages)[1] == 0, test, "code lines must be cleared");
+}
+
+// The same for a mirror within a TCM.
+static void TestWriteToTCMMirror() {
+  auto test = "TestWriteToTCMMirror";
+  auto memory = TestMemory{};
+  u8 data[0x8000];
+
+  memory.itcm.data = data;
+  memory.itcm.mask = sizeof(data) - 1;
+  memory.itcm.config = {.enable = true, .enable_read = true, .base = 0, .limit = 0x1FFFF};
+
+  auto block_cache = BasicBlockCache{memory};
+  auto key = BasicBlock::Key{8, Mode::System, false};
+  auto basic_block = new BasicBlock{key};
+
+  basic_block->AddAddressRange(0x100, sizeof(u32));
+  block_cache.Set(key, basic_block);
+
+  block_cache.FlushWrite(0x18100, sizeof(u32));
+
+  Expect(block_cache.Get(key) == nullptr, test, "write to the mirror must invalidate the basic block");
+}
+
+int main() {
+  TestRemoveAtWrapAround();
+  TestRemoveFromCollisionChain();
+  TestGrow();
+  TestInlineCacheStatistics();
+  TestWriteToPageTableMirror();
+  TestWriteToTCMMirror();
+
+  return ReportResults();
+}
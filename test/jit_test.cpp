@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <chrono>
+#include <functional>
+#include <lunatic/cpu.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_common.hpp"
+
+using namespace lunatic;
+
+using Engine = CPU::Descriptor::Engine;
+
+struct TestCPU {
+  TestMemory memory;
+  std::unique_ptr<CPU> cpu;
+};
+
+using Configure = std::function<void(CPU::Descriptor&)>;
+
+// Create a CPU which starts at address zero, with the given code loaded there.
+// Thumb code is given as one halfword per element.
+static auto CreateTestCPU(Engine engine, std::vector<u32> const& code, bool thumb, Configure const& configure) -> std::unique_ptr<TestCPU> {
+  auto test_cpu = std::make_unique<TestCPU>();
+  auto& memory = test_cpu->memory;
+  auto address = 0U;
+
+  for (auto opcode : code) {
+    if (thumb) {
+      memory.WriteHalf(address, u16(opcode));
+      address += sizeof(u16);
+    } else {
+      memory.WriteWord(address, opcode);
+      address += sizeof(u32);
+    }
+  }
+
+  memory.MapPageTable();
+
+  auto descriptor = CPU::Descriptor{.memory = memory, .engine = engine};
+
+  if (configure) {
+    configure(descriptor);
+  }
+
+  auto cpsr = StatusRegister{};
+  cpsr.f.mode = Mode::System;
+  cpsr.f.thumb = thumb ? 1 : 0;
+
+  test_cpu->cpu = CreateCPU(descriptor);
+  test_cpu->cpu->Reset();
+  test_cpu->cpu->SetCPSR(cpsr);
+  test_cpu->cpu->SetGPR(GPR::PC, 0);
+  return test_cpu;
+}
+
+static void ExpectSameState(char const* test, TestCPU& jit, TestCPU& interpreter) {
+  for (int i = 0; i <= 15; i++) {
+    auto reg = GPR(i);
+    auto message = "R" + std::to_string(i) + " must match the interpreter";
+
+    Expect(jit.cpu->GetGPR(reg) == interpreter.cpu->GetGPR(reg), test, message.c_str());
+  }
+
+  Expect(jit.cpu->GetCPSR().v == interpreter.cpu->GetCPSR().v, test, "CPSR must match the interpreter");
+  Expect(std::memcmp(jit.memory.data, interpreter.memory.data, sizeof(TestMemory::data)) == 0, test, "memory must match the interpreter");
+}
+
+/* Run the code on the JIT and on the interpreter and compare the resulting state.
+ * The code must end in an endless loop, which both engines reach within the given number of cycles.
+ */
+static void ExpectSameAsInterpreter(char const* test, std::vector<u32> const& code, bool thumb = false, Configure const& configure = {}, int cycles = 1000) {
+  auto jit = CreateTestCPU(Engine::JIT, code, thumb, configure);
+  auto interpreter = CreateTestCPU(Engine::Interpreter, code, thumb, configure);
+
+  jit->cpu->Run(cycles);
+  interpreter->cpu->Run(cycles);
+
+  ExpectSameState(test, *jit, *interpreter);
+}
+
+// The flags of a flag-setting opcode must survive a store which calls into the Memory interface.
+static void TestFlagsAcrossSlowMemoryWrite() {
+  ExpectSameAsInterpreter("TestFlagsAcrossSlowMemoryWrite", {
+    0xE3A00801, // mov r0, #0x10000 (not in the page table)
+    0xE3A01005, // mov r1, #5
+    0xE2511005, // subs r1, r1, #5
+    0xE5801800, // str r1, [r0, #0x800]
+    0x03A02001, // moveq r2, #1
+    0x13A02002, // movne r2, #2
+    0xEAFFFFFE  // b .
+  });
+}
+
+// CLZ of constant operands is folded at compile time, including the zero operand.
+static void TestConstantCountLeadingZeros() {
+  ExpectSameAsInterpreter("TestConstantCountLeadingZeros", {
+    0xE3A00C01, // mov r0, #0x100
+    0xE16F1F10, // clz r1, r0
+    0xE3A02000, // mov r2, #0
+    0xE16F3F12, // clz r3, r2
+    0xEAFFFFFE  // b .
+  });
+}
+
+static void TestARM(Configure const& configure = {}) {
+  ExpectSameAsInterpreter("TestARM (data processing)", {
+    0xE3A00000, // mov r0, #0
+    0xE3A0100A, // mov r1, #10
+    0xE0800001, // add r0, r0, r1
+    0xE2511001, // subs r1, r1, #1
+    0x1AFFFFFC, // bne 8
+    0xE0A02180, // adc r2, r0, r0, lsl #3
+    0xE2723000, // rsbs r3, r2, #0
+    0xE1B04FC3, // movs r4, r3, asr #31
+    0xE0050392, // mul r5, r2, r3
+    0xE0876392, // umull r6, r7, r2, r3
+    0xEAFFFFFE  // b .
+  }, false, configure);
+
+  ExpectSameAsInterpreter("TestARM (memory)", {
+    0xE3A00B02, // mov r0, #0x800
+    0xE3A01001, // mov r1, #1
+    0xE3A02002, // mov r2, #2
+    0xE3E03000, // mvn r3, #0
+    0xE8A0000E, // stmia r0!, {r1-r3}
+    0xE5504001, // ldrb r4, [r0, #-1]
+    0xE15050F2, // ldrsh r5, [r0, #-2]
+    0xE91001C0, // ldmdb r0, {r6-r8}
+    0xE1C030B2, // strh r3, [r0, #2]
+    0xE1009091, // swp r9, r1, [r0]
+    0xEAFFFFFE  // b .
+  }, false, configure);
+}
+
+static void TestThumb(Configure const& configure = {}) {
+  ExpectSameAsInterpreter("TestThumb", {
+    0x2000, // movs r0, #0
+    0x210A, // movs r1, #10
+    0x1840, // adds r0, r0, r1
+    0x3901, // subs r1, #1
+    0xD1FC, // bne 4
+    0x00C2, // lsls r2, r0, #3
+    0x43D3, // mvns r3, r2
+    0x4343, // muls r3, r0
+    0x2480, // movs r4, #0x80
+    0x0124, // lsls r4, r4, #4
+    0x46A5, // mov sp, r4
+    0xB40F, // push {r0-r3}
+    0xBCF0, // pop {r4-r7}
+    0xE7FE  // b .
+  }, true, configure);
+}
+
+static void TestBackgroundCompilation() {
+  auto configure = [](CPU::Descriptor& descriptor) {
+    descriptor.background_compilation = true;
+  };
+
+  TestARM(configure);
+  TestThumb(configure);
+}
+
+/* Code that changes after the worker thread translated it must not be published.
+ * The basic block is translated again and the interpreter runs the new code until then.
+ */
+static void TestBackgroundCompilationOfModifiedCode() {
+  auto test = "TestBackgroundCompilationOfModifiedCode";
+  auto jit = CreateTestCPU(Engine::JIT, {
+    0xE3A00001, // mov r0, #1
+    0xEAFFFFFE  // b .
+  }, false, [](CPU::Descriptor& descriptor) {
+    descriptor.background_compilation = true;
+  });
+
+  auto& cpu = *jit->cpu;
+
+  // Queue the basic block for translation and give the worker thread time to translate it.
+  cpu.Run(1);
+  std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+  jit->memory.WriteWord(0, 0xE3A00002); // mov r0, #2
+
+  cpu.SetGPR(GPR::R0, 0);
+  cpu.SetGPR(GPR::PC, 0);
+  cpu.Run(100);
+
+  Expect(cpu.GetGPR(GPR::R0) == 2, test, "stale translation must not run");
+
+  // Run the new translation once it is ready.
+  std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+  cpu.SetGPR(GPR::R0, 0);
+  cpu.SetGPR(GPR::PC, 0);
+  cpu.Run(100);
+
+  Expect(cpu.GetGPR(GPR::R0) == 2, test, "new translation must run the modified code");
+}
+
+// Nested function calls, and a function that does not return to its caller, which the return stack buffer mispredicts.
+static void TestFunctionCalls() {
+  ExpectSameAsInterpreter("TestFunctionCalls", {
+    0xE3A0DA01, // mov sp, #0x1000
+    0xE3A00000, // mov r0, #0
+    0xE3A04003, // mov r4, #3
+    0xEB000007, // bl 0x30
+    0xEB00000E, // bl 0x50
+    0xE2800C01, // add r0, r0, #0x100 (skipped)
+    0xE2544001, // subs r4, r4, #1
+    0x1AFFFFFA, // bne 0xC
+    0xEAFFFFFE, // b .
+    0xE1A00000, // nop
+    0xE1A00000, // nop
+    0xE1A00000, // nop
+    0xE52DE004, // 0x30: str lr, [sp, #-4]!
+    0xE2800001, // add r0, r0, #1
+    0xEB000002, // bl 0x48
+    0xE49DE004, // ldr lr, [sp], #4
+    0xE12FFF1E, // bx lr
+    0xE1A00000, // nop
+    0xE2800010, // 0x48: add r0, r0, #0x10
+    0xE12FFF1E, // bx lr
+    0xE28EE004, // 0x50: add lr, lr, #4
+    0xE12FFF1E  // bx lr
+  });
+}
+
+// An indirect branch with more targets than its inline cache holds, which makes it megamorphic.
+static void TestIndirectBranches() {
+  ExpectSameAsInterpreter("TestIndirectBranches", {
+    0xE3A00000, // mov r0, #0
+    0xE3A01000, // mov r1, #0
+    0xE2012003, // 0x08: and r2, r1, #3
+    0xE08FF182, // add pc, pc, r2, lsl #3
+    0xE1A00000, // nop
+    0xE2800001, // add r0, r0, #1
+    0xEA000005, // b 0x34
+    0xE2800002, // add r0, r0, #2
+    0xEA000003, // b 0x34
+    0xE22000FF, // eor r0, r0, #0xFF
+    0xEA000001, // b 0x34
+    0xE0800000, // add r0, r0, r0
+    0xEAFFFFFF, // b 0x34
+    0xE2811001, // 0x34: add r1, r1, #1
+    0xE3510B01, // cmp r1, #0x400
+    0x1AFFFFF1, // bne 0x08
+    0xEAFFFFFE  // b .
+  }, false, {}, 100000);
+}
+
+// Conditional forward branches inside of a loop, which are compiled into superblocks, both taken and not taken.
+static void TestConditionalBranches() {
+  auto code = std::vector<u32>{
+    0xE3A00000, // mov r0, #0
+    0xE3A01000, // mov r1, #0
+    0xE3110001, // 0x08: tst r1, #1
+    0x12800003, // addne r0, r0, #3
+    0x0A000001, // beq 0x1C
+    0xE08000A0, // add r0, r0, r0, lsr #1
+    0xE2200005, // eor r0, r0, #5
+    0xE2811001, // 0x1C: add r1, r1, #1
+    0xE3510014, // cmp r1, #20
+    0xBAFFFFF7, // blt 0x08
+    0xEAFFFFFE  // b .
+  };
+
+  ExpectSameAsInterpreter("TestConditionalBranches", code);
+
+  ExpectSameAsInterpreter("TestConditionalBranches (optimized)", code, false, [](CPU::Descriptor& descriptor) {
+    descriptor.hotness_threshold = 0;
+  });
+}
+
+// Guest writes to code that has been compiled must invalidate it.
+static void TestSelfModifyingCode() {
+  auto code = std::vector<u32>{
+    0xE3A00000, // mov r0, #0
+    0xE59F1018, // ldr r1, [pc, #0x18]
+    0xE3A04003, // mov r4, #3
+    0xEB00001B, // 0x0C: bl 0x80
+    0xE58F1068, // str r1, [pc, #0x68]
+    0xE2544001, // subs r4, r4, #1
+    0x1AFFFFFB, // bne 0x0C
+    0xEAFFFFFE, // b .
+    0xE1A00000, // nop
+    0xE2800010  // 0x24: add r0, r0, #0x10
+  };
+
+  code.resize(0x80 / sizeof(u32));
+  code.push_back(0xE2800001); // 0x80: add r0, r0, #1
+  code.push_back(0xE12FFF1E); // bx lr
+
+  ExpectSameAsInterpreter("TestSelfModifyingCode", code);
+}
+
+/* Run a loop over more basic blocks than fit into a small code buffer.
+ * Code regions are evicted while the basic blocks in them are linked to each other,
+ * and the code of baseline tier basic blocks is reused once they are optimized.
+ */
+static void TestSmallCodeBuffer() {
+  auto code = std::vector<u32>{
+    0xE3A00000, // mov r0, #0
+    0xE3A01008  // mov r1, #8
+  };
+
+  for (u32 i = 0; i < 96; i++) {
+    code.push_back(0xE2800001 + i);   // add r0, r0, #(i + 1)
+    code.push_back(0xE0202080);       // eor r2, r0, r0, lsl #1
+    code.push_back(0xE08001A2);       // add r0, r0, r2, lsr #3
+    code.push_back(0xEAFFFFFF);       // b (next opcode)
+  }
+
+  code.push_back(0xE2511001);         // subs r1, r1, #1
+  code.push_back(0x1AFFFE7D);         // bne 8
+  code.push_back(0xEAFFFFFE);         // b .
+
+  ExpectSameAsInterpreter("TestSmallCodeBuffer", code, false, [](CPU::Descriptor& descriptor) {
+    descriptor.code_buffer_size = 12 * 1024;
+  }, 100000);
+
+  ExpectSameAsInterpreter("TestSmallCodeBuffer (tiered)", code, false, [](CPU::Descriptor& descriptor) {
+    descriptor.code_buffer_size = 12 * 1024;
+    descriptor.hotness_threshold = 2;
+  }, 100000);
+}
+
+/* Keep more guest GPRs busy in a loop than can be pinned to host registers,
+ * and more values alive than there are host registers, across memory accesses that call into C++ code.
+ */
+static void TestRegisterPressure() {
+  auto code = std::vector<u32>{
+    0xE3A00B02, // mov r0, #0x800
+    0xE3A0D004, // mov sp, #4
+    0xE3A0E801, // mov lr, #0x10000 (not in the page table)
+    0xE8901FFE, // ldmia r0, {r1-r12}
+    0xE58EC800, // str r12, [lr, #0x800]
+    0xE0811002, // add r1, r1, r2
+    0xE0822003, // add r2, r2, r3
+    0xE0833004, // add r3, r3, r4
+    0xE0844005, // add r4, r4, r5
+    0xE0855006, // add r5, r5, r6
+    0xE0866007, // add r6, r6, r7
+    0xE0877008, // add r7, r7, r8
+    0xE0888009, // add r8, r8, r9
+    0xE089900A, // add r9, r9, r10
+    0xE08AA00B, // add r10, r10, r11
+    0xE08BB00C, // add r11, r11, r12
+    0xE02CC001, // eor r12, r12, r1
+    0xE59EC800, // ldr r12, [lr, #0x800]
+    0xE081100C, // add r1, r1, r12
+    0xE8801FFE, // stmia r0, {r1-r12}
+    0xE25DD001, // subs sp, sp, #1
+    0x1AFFFFED, // bne 0xC
+    0xEAFFFFFE  // b .
+  };
+
+  // Initial values of r1 to r12 at 0x800.
+  code.resize(0x800 / sizeof(u32));
+
+  for (u32 i = 1; i <= 12; i++) {
+    code.push_back(i * 0x01010101);
+  }
+
+  ExpectSameAsInterpreter("TestRegisterPressure", code);
+
+  // Compile the optimized tier right away.
+  ExpectSameAsInterpreter("TestRegisterPressure (optimized)", code, false, [](CPU::Descriptor& descriptor) {
+    descriptor.hotness_threshold = 0;
+  });
+}
+
+// Assigning to IRQLine() raises the IRQ line like SetIRQLine() does.
+static void TestIRQLineReference(Engine engine) {
+  auto test = engine == Engine::JIT ? "TestIRQLineReference (JIT)" : "TestIRQLineReference (Interpreter)";
+  auto test_cpu = CreateTestCPU(engine, {
+    0xEAFFFFFE, // b .
+    0xE1A00000, // nop
+    0xE1A00000, // nop
+    0xE1A00000, // nop
+    0xE1A00000, // nop
+    0xE1A00000, // nop
+    0xE3A00001, // mov r0, #1 (IRQ vector)
+    0xEAFFFFFE  // b .
+  }, false, {});
+
+  auto& cpu = *test_cpu->cpu;
+
+  cpu.Run(100);
+  cpu.IRQLine() = true;
+  Expect(cpu.IRQLine(), test, "IRQ line must be raised");
+  cpu.Run(100);
+
+  Expect(cpu.GetCPSR().f.mode == Mode::IRQ, test, "IRQ must be taken");
+  Expect(cpu.GetGPR(GPR::R0) == 1, test, "IRQ handler must run");
+}
+
+int main() {
+  TestFlagsAcrossSlowMemoryWrite();
+  TestConstantCountLeadingZeros();
+  TestARM();
+  TestThumb();
+  TestBackgroundCompilation();
+  TestBackgroundCompilationOfModifiedCode();
+  TestFunctionCalls();
+  TestIndirectBranches();
+  TestSelfModifyingCode();
+  TestConditionalBranches();
+  TestSmallCodeBuffer();
+  TestRegisterPressure();
+  TestIRQLineReference(Engine::JIT);
+  TestIRQLineReference(Engine::Interpreter);
+
+  return ReportResults();
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <lunatic/memory.hpp>
+
+namespace lunatic {
+
+struct TestMemory final : Memory {
+  TestMemory() {
+    std::memset(data, 0xFF, sizeof(data));
+  }
+
+  auto ReadByte(u32 address, Bus bus) ->  u8 override {
+    return data[address & kMask];
+  }
+
+  auto ReadHalf(u32 address, Bus bus) -> u16 override {
+    return ReadByte(address, bus) | (ReadByte(address + 1, bus) << 8);
+  }
+
+  auto ReadWord(u32 address, Bus bus) -> u32 override {
+    return ReadHalf(address, bus) | (ReadHalf(address + 2, bus) << 16);
+  }
+
+  void WriteByte(u32 address, u8 value, Bus bus) override {
+    data[address & kMask] = value;
+  }
+
+  void WriteHalf(u32 address, u16 value, Bus bus) override {
+    WriteByte(address + 0, u8(value));
+    WriteByte(address + 1, u8(value >> 8));
+  }
+
+  void WriteWord(u32 address, u32 value, Bus bus) override {
+    WriteHalf(address + 0, u16(value));
+    WriteHalf(address + 2, u16(value >> 16));
+  }
+
+  void WriteByte(u32 address, u8 value) { WriteByte(address, value, Bus::System); }
+  void WriteHalf(u32 address, u16 value) { WriteHalf(address, value, Bus::System); }
+  void WriteWord(u32 address, u32 value) { WriteWord(address, value, Bus::System); }
+
+  // Map the memory into the page table, so that the JIT and the translator may access it directly.
+  void MapPageTable() {
+    pagetable = std::make_unique<std::array<u8*, 1048576>>();
+
+    for (u32 page = 0; page < sizeof(data) >> kPageShift; page++) {
+      (*pagetable)[page] = &data[page << kPageShift];
+    }
+  }
+
+  static constexpr u32 kMask = 0xFFFF;
+
+  u8 data[kMask + 1];
+};
+
+static int failures = 0;
+
+static void Expect(bool condition, char const* test, char const* message) {
+  if (!condition) {
+    std::printf("FAIL %s: %s\n", test, message);
+    failures++;
+  }
+}
+
+static int ReportResults() {
+  if (failures == 0) {
+    std::puts("All tests passed.");
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+} // namespace lunatic
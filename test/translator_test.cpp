@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <lunatic/cpu.hpp>
+
+#include "frontend/translator/translator.hpp"
+#include "test_common.hpp"
+
+using namespace lunatic;
+using namespace lunatic::frontend;
+
+// An unconditional branch back to the start ends the basic block, the code after it must not be translated.
+static void TestLoopBackEdgeEndsBasicBlock(bool thumb) {
+  auto test = thumb ? "TestLoopBackEdgeEndsBasicBlock (Thumb)" : "TestLoopBackEdgeEndsBasicBlock (ARM)";
+  auto memory = TestMemory{};
+  auto translator = Translator{CPU::Descriptor{.memory = memory}};
+
+  if (thumb) {
+    memory.WriteHalf(0, 0x2001); // movs r0, #1
+    memory.WriteHalf(2, 0xE7FD); // b 0
+  } else {
+    memory.WriteWord(0, 0xE3A00001); // mov r0, #1
+    memory.WriteWord(4, 0xEAFFFFFD); // b 0
+    memory.WriteWord(8, 0xE3A01002); // mov r1, #2
+  }
+
+  // The key holds the address of the first opcode plus two opcodes (the value that R15 reads as).
+  auto key = BasicBlock::Key{thumb ? 4U : 8U, Mode::System, thumb};
+  auto basic_block = BasicBlock{key};
+
+  translator.Translate(basic_block);
+
+  Expect(basic_block.length == 2, test, "basic block must end at the branch");
+
+  for (auto const& micro_block : basic_block.micro_blocks) {
+    Expect(micro_block.side_exit.key.value == 0, test, "branch must not be a side exit");
+  }
+  Expect(basic_block.branch_target.key.value == key.value, test, "branch target must be the basic block itself");
+}
+
+// A loop polling memory is only an idle loop if it reads plain memory, since I/O reads may have side effects.
+static void TestIdleLoopRequiresRAM(bool ram) {
+  auto test = ram ? "TestIdleLoopRequiresRAM (RAM)" : "TestIdleLoopRequiresRAM (I/O)";
+  auto memory = TestMemory{};
+  auto translator = Translator{CPU::Descriptor{.memory = memory}};
+
+  if (ram) {
+    memory.MapPageTable();
+  }
+
+  memory.WriteWord(0, 0xE59F0008); // ldr r0, [pc, #8]
+  memory.WriteWord(4, 0xE3500000); // cmp r0, #0
+  memory.WriteWord(8, 0x0AFFFFFC); // beq 0
+  memory.WriteWord(12, 0xE12FFF1E); // bx lr
+
+  auto key = BasicBlock::Key{8, Mode::System, false};
+  auto basic_block = BasicBlock{key};
+  bool idle_loop = false;
+
+  translator.Translate(basic_block);
+
+  for (auto const& micro_block : basic_block.micro_blocks) {
+    if (micro_block.side_exit.key.value == key.value) {
+      idle_loop = micro_block.side_exit.idle_loop;
+    }
+  }
+
+  Expect(idle_loop == ram, test, ram ? "loop must be an idle loop" : "loop must not be an idle loop");
+}
+
+// A translator restricted to direct fetches must not call into the Memory interface.
+static void TestDirectFetchOnly() {
+  auto test = "TestDirectFetchOnly";
+  auto memory = TestMemory{};
+  auto translator = Translator{CPU::Descriptor{.memory = memory}, true};
+  auto key = BasicBlock::Key{8, Mode::System, false};
+  bool indirect_fetch = false;
+
+  memory.WriteWord(0, 0xE12FFF1E); // bx lr
+
+  try {
+    auto basic_block = BasicBlock{key};
+    translator.Translate(basic_block);
+  } catch (Translator::IndirectFetch const&) {
+    indirect_fetch = true;
+  }
+
+  Expect(indirect_fetch, test, "fetch outside of the page table must be rejected");
+
+  memory.MapPageTable();
+
+  auto basic_block = BasicBlock{key};
+  translator.Translate(basic_block);
+
+  Expect(basic_block.length == 1, test, "fetch from the page table must be allowed");
+}
+
+int main() {
+  TestLoopBackEdgeEndsBasicBlock(false);
+  TestLoopBackEdgeEndsBasicBlock(true);
+  TestIdleLoopRequiresRAM(false);
+  TestIdleLoopRequiresRAM(true);
+  TestDirectFetchOnly();
+
+  return ReportResults();
+}